@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+#include "generate_data.hpp"
+#include "hittable_list.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+
+// Build and trace time of the linear scan, the quantized BVH and the uniform
+// grid on DataGenerator lattices of growing size. Build times exclude
+// generating the spheres themselves.
+namespace {
+
+using T = double;
+
+constexpr auto ray_count = std::size_t{1} << 16;
+// The linear scan is quadratic overall; skip it past this many spheres.
+constexpr auto max_list_size = std::size_t{20000};
+
+template <class Fn>
+auto seconds(Fn&& fn) -> double {
+  const auto start = std::chrono::steady_clock::now();
+  fn();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Rays from above the lattice down to random points on it, the same for
+// every structure.
+auto make_rays(const int extent) -> std::vector<Ray<T>> {
+  auto gen = std::mt19937(1);
+  auto on_lattice = std::uniform_real_distribution<T>(-extent, extent);
+  auto height = std::uniform_real_distribution<T>(1, 4);
+  auto rays = std::vector<Ray<T>>{};
+  rays.reserve(ray_count);
+  for (auto i = std::size_t{0}; i < ray_count; ++i) {
+    const auto from = Point3<T>{on_lattice(gen), height(gen), on_lattice(gen)};
+    const auto to = Point3<T>{on_lattice(gen), 0, on_lattice(gen)};
+    rays.emplace_back(from, to - from);
+  }
+  return rays;
+}
+
+// The spheres as CompactSphereSet stores them, centers and radii rounded to
+// float. Every structure traces these, so a grazing ray cannot hit the double
+// list and miss the packed copy.
+auto round_to_float(const std::vector<Sphere<T>>& spheres)
+    -> std::vector<Sphere<T>> {
+  auto narrow = [](const T& x) -> T { return static_cast<float>(x); };
+  auto rounded = std::vector<Sphere<T>>{};
+  rounded.reserve(spheres.size());
+  for (const auto& s : spheres)
+    rounded.emplace_back(Point3<T>{narrow(s.center().x()),
+                                   narrow(s.center().y()),
+                                   narrow(s.center().z())},
+                         narrow(s.radius()), s.material());
+  return rounded;
+}
+
+struct Packed {
+  std::vector<PackedSphere> spheres{};
+  std::vector<Material_t<T>> materials{};
+};
+
+// The input of CompactSphereSet; nullopt if the materials overflow its
+// palette.
+auto pack(const std::vector<Sphere<T>>& spheres) -> std::optional<Packed> {
+  auto palette = PaletteBuilder<T>{};
+  auto packed = Packed{};
+  packed.spheres.reserve(spheres.size());
+  for (const auto& s : spheres) {
+    const auto material = palette.add(s.material(), packed.spheres);
+    if (!material)
+      return std::nullopt;
+    packed.spheres.push_back(PackedSphere{
+        .x = static_cast<float>(s.center().x()),
+        .y = static_cast<float>(s.center().y()),
+        .z = static_cast<float>(s.center().z()),
+        .radius = static_cast<float>(s.radius()),
+        .material = material.value()});
+  }
+  packed.materials = std::move(palette).materials();
+  return packed;
+}
+
+auto report(const int extent,
+            const char* name,
+            const HittableList<T>& world,
+            const double build_s,
+            const std::vector<Ray<T>>& rays) -> std::size_t {
+  auto hits = std::size_t{0};
+  const auto trace_s = seconds([&] {
+    for (const auto& ray : rays)
+      if (world.hit(ray, Interval<T>{0, globals::infinity<T>}))
+        ++hits;
+  });
+  std::cout << std::format(
+      "{:>6} {:>8} {:>6} {:>10.2f} {:>8.3f} {:>10} {:>6}\n", extent,
+      world.primitive_count(), name, build_s * 1e3,
+      static_cast<double>(rays.size()) / trace_s / 1e6, world.memory_bytes(),
+      hits);
+  return hits;
+}
+
+}  // namespace
+
+// Exits non-zero if a structure finds a different number of hits than the
+// list scan, or than the BVH where the list is skipped, so a traversal bug
+// cannot pass for a fast run.
+auto main() -> int {
+  std::cout << std::format("{:>6} {:>8} {:>6} {:>10} {:>8} {:>10} {:>6}\n",
+                           "extent", "spheres", "accel", "build ms",
+                           "Mrays/s", "bytes", "hits");
+  auto mismatches = 0;
+  for (const auto extent : {11, 22, 44, 88, 176}) {
+    const auto spheres =
+        round_to_float(DataGenerator<T>(extent).get_sphere_vector());
+    const auto rays = make_rays(extent);
+
+    auto expected = std::optional<std::size_t>{};
+    auto check = [&](const char* name, const std::size_t hits) {
+      if (!expected) {
+        expected = hits;
+      } else if (hits != expected.value()) {
+        std::cerr << std::format("extent {}: {} found {} hits, expected {}\n",
+                                 extent, name, hits, expected.value());
+        ++mismatches;
+      }
+    };
+
+    if (spheres.size() <= max_list_size) {
+      auto list = HittableList<T>{};
+      const auto list_s = seconds([&] {
+        std::ranges::for_each(spheres, [&list](auto& s) { list.add(s); });
+      });
+      check("list", report(extent, "list", list, list_s, rays));
+    }
+
+    auto packed = pack(spheres);
+    if (!packed) {
+      std::cerr << "extent " << extent
+                << ": materials overflow the compact palette\n";
+      return EXIT_FAILURE;
+    }
+    auto bvh = HittableList<T>{};
+    const auto bvh_s = seconds([&] {
+      bvh.add(CompactSphereSet<T>{std::move(packed->spheres),
+                                  std::move(packed->materials)});
+    });
+    check("bvh", report(extent, "bvh", bvh, bvh_s, rays));
+
+    auto grid = HittableList<T>{};
+    auto copy = spheres;
+    const auto grid_s =
+        seconds([&] { grid.add(SphereGrid<T>{std::move(copy)}); });
+    check("grid", report(extent, "grid", grid, grid_s, rays));
+  }
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
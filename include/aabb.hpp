@@ -0,0 +1,103 @@
+#ifndef AABB_HPP
+#define AABB_HPP
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include "globals.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+#include "vec3.hpp"
+
+template <class T>
+class Aabb {
+ public:
+  Aabb()
+      : m_min(Point3<T>{globals::infinity<T>, globals::infinity<T>,
+                        globals::infinity<T>}),
+        m_max(Point3<T>{-globals::infinity<T>, -globals::infinity<T>,
+                        -globals::infinity<T>}) {};
+  Aabb(const Point3<T>& min, const Point3<T>& max) : m_min(min), m_max(max) {};
+
+  [[nodiscard]] auto min() const noexcept -> const Point3<T>& { return m_min; }
+  [[nodiscard]] auto max() const noexcept -> const Point3<T>& { return m_max; }
+  [[nodiscard]] auto extent() const noexcept -> Vec3<T> {
+    return m_max - m_min;
+  }
+  [[nodiscard]] auto centroid() const noexcept -> Point3<T> {
+    return (m_min + m_max) * T{0.5};
+  }
+  [[nodiscard]] auto longest_axis() const noexcept -> int;
+  [[nodiscard]] auto empty() const noexcept -> bool {
+    return m_min.x() > m_max.x();
+  }
+
+  [[nodiscard]] auto merge(const Aabb<T>& other) const noexcept -> Aabb<T>;
+  [[nodiscard]] auto merge(const Point3<T>& p) const noexcept -> Aabb<T>;
+
+  // Slab test, returns the entry distance clipped to ray_t.
+  [[nodiscard]] auto hit(const Ray<T>& ray,
+                         const Vec3<T>& inv_direction,
+                         const Interval<T>& ray_t) const noexcept
+      -> std::optional<T>;
+
+ private:
+  Point3<T> m_min;
+  Point3<T> m_max;
+};
+
+template <class T>
+[[nodiscard]] inline auto axis(const Vec3<T>& v, const int a) noexcept -> T {
+  return a == 0 ? v.x() : (a == 1 ? v.y() : v.z());
+}
+
+template <class T>
+[[nodiscard]] inline auto inverse(const Vec3<T>& v) noexcept -> Vec3<T> {
+  return Vec3<T>{T{1} / v.x(), T{1} / v.y(), T{1} / v.z()};
+}
+
+template <class T>
+auto Aabb<T>::longest_axis() const noexcept -> int {
+  const auto e = extent();
+  if (e.x() > e.y() && e.x() > e.z())
+    return 0;
+  return e.y() > e.z() ? 1 : 2;
+}
+
+template <class T>
+auto Aabb<T>::merge(const Aabb<T>& other) const noexcept -> Aabb<T> {
+  return Aabb<T>{Point3<T>{std::min(m_min.x(), other.m_min.x()),
+                           std::min(m_min.y(), other.m_min.y()),
+                           std::min(m_min.z(), other.m_min.z())},
+                 Point3<T>{std::max(m_max.x(), other.m_max.x()),
+                           std::max(m_max.y(), other.m_max.y()),
+                           std::max(m_max.z(), other.m_max.z())}};
+}
+
+template <class T>
+auto Aabb<T>::merge(const Point3<T>& p) const noexcept -> Aabb<T> {
+  return merge(Aabb<T>{p, p});
+}
+
+template <class T>
+auto Aabb<T>::hit(const Ray<T>& ray,
+                  const Vec3<T>& inv_direction,
+                  const Interval<T>& ray_t) const noexcept -> std::optional<T> {
+  auto t_min = ray_t.min();
+  auto t_max = ray_t.max();
+  for (auto a = 0; a < 3; ++a) {
+    const auto inv = axis(inv_direction, a);
+    const auto origin = axis(ray.origin(), a);
+    auto t0 = (axis(m_min, a) - origin) * inv;
+    auto t1 = (axis(m_max, a) - origin) * inv;
+    if (inv < 0)
+      std::swap(t0, t1);
+    t_min = t0 > t_min ? t0 : t_min;
+    t_max = t1 < t_max ? t1 : t_max;
+    if (t_max < t_min)
+      return std::nullopt;
+  }
+  return t_min;
+}
+
+#endif  // !AABB_HPP
@@ -0,0 +1,125 @@
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "color.hpp"
+
+// Writes a P3 image from rows handed over by the tracing thread. Rows wait
+// in a bounded queue; a writer thread encodes them in order into a large
+// buffer and hands that to the stream in big writes, so a slow disk or a
+// full pipe only blocks tracing once the queue is full.
+template <class T>
+class AsyncRowWriter {
+ public:
+  static constexpr std::size_t buffer_bytes = std::size_t{1} << 20;
+
+  AsyncRowWriter() = delete;
+  AsyncRowWriter(std::ostream& out,
+                 const std::size_t width,
+                 const std::size_t height,
+                 const std::size_t max_queued_rows = 64)
+      : m_out(out),
+        m_max_queued(std::max<std::size_t>(max_queued_rows, 1)),
+        m_header("P3\n" + std::to_string(width) + ' ' +
+                 std::to_string(height) + "\n255\n"),
+        m_thread([this] { write_loop(); }) {};
+  AsyncRowWriter(const AsyncRowWriter&) = delete;
+  auto operator=(const AsyncRowWriter&) -> AsyncRowWriter& = delete;
+  ~AsyncRowWriter() { finish(); }
+
+  // Blocks while the queue is full.
+  auto push(std::vector<Color<T>> row) -> void;
+  // Returns once every pushed row is written and the stream flushed.
+  auto finish() -> void;
+
+ private:
+  auto write_loop() -> void;
+  static auto encode(const std::vector<Color<T>>& row, std::string& buffer)
+      -> void;
+
+  std::ostream& m_out;
+  const std::size_t m_max_queued{};
+  const std::string m_header{};
+  std::mutex m_mutex{};
+  std::condition_variable m_not_empty{};
+  std::condition_variable m_not_full{};
+  std::deque<std::vector<Color<T>>> m_rows{};
+  bool m_closed{};
+  // last, so the queue exists before the thread starts
+  std::jthread m_thread;
+};
+
+template <class T>
+auto AsyncRowWriter<T>::push(std::vector<Color<T>> row) -> void {
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_not_full.wait(lock, [this] { return m_rows.size() < m_max_queued; });
+    m_rows.push_back(std::move(row));
+  }
+  m_not_empty.notify_one();
+}
+
+template <class T>
+auto AsyncRowWriter<T>::finish() -> void {
+  {
+    const auto lock = std::scoped_lock(m_mutex);
+    m_closed = true;
+  }
+  m_not_empty.notify_one();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+template <class T>
+auto AsyncRowWriter<T>::write_loop() -> void {
+  auto buffer = m_header;
+  buffer.reserve(buffer_bytes);
+  while (true) {
+    auto row = std::vector<Color<T>>{};
+    {
+      auto lock = std::unique_lock(m_mutex);
+      m_not_empty.wait(lock, [this] { return !m_rows.empty() || m_closed; });
+      if (m_rows.empty())
+        break;
+      row = std::move(m_rows.front());
+      m_rows.pop_front();
+    }
+    m_not_full.notify_one();
+
+    encode(row, buffer);
+    if (buffer.size() >= buffer_bytes) {
+      m_out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      buffer.clear();
+    }
+  }
+  m_out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  m_out.flush();
+}
+
+// Same text as write_color, without going through the stream per value.
+template <class T>
+auto AsyncRowWriter<T>::encode(const std::vector<Color<T>>& row,
+                               std::string& buffer) -> void {
+  char text[16];
+  for (const auto& pixel : row) {
+    const auto rgb = to_rgb8(pixel);
+    auto* p = text;
+    for (auto c = std::size_t{0}; c < 3; ++c) {
+      p = std::to_chars(p, text + sizeof(text), rgb[c]).ptr;
+      *p++ = c < 2 ? ' ' : '\n';
+    }
+    buffer.append(text, p);
+  }
+}
+
+#endif  // !ASYNC_WRITER_HPP
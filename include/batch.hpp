@@ -0,0 +1,134 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <istream>
+#include <optional>
+#include <ranges>
+#include <vector>
+#include "camera.hpp"
+#include "camera_keys.hpp"
+#include "framebuffer.hpp"
+#include "globals.hpp"
+#include "hittable_list.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+#include "vec3.hpp"
+
+template <class T>
+struct CameraView {
+  Point3<T> lookfrom{};
+  Point3<T> lookat{};
+  T v_fov{};
+};
+
+// One view per line: `lookfrom.xyz lookat.xyz v_fov`, '#' starts a comment.
+template <class T>
+[[nodiscard]] auto parse_camera_views(std::istream& in)
+    -> std::optional<std::vector<CameraView<T>>> {
+  const auto lines = parse_key_lines<T, 7>(in);
+  if (!lines)
+    return std::nullopt;
+  auto views = std::vector<CameraView<T>>{};
+  for (const auto& v : lines.value())
+    views.push_back(CameraView<T>{.lookfrom = Point3<T>{v[0], v[1], v[2]},
+                                  .lookat = Point3<T>{v[3], v[4], v[5]},
+                                  .v_fov = v[6]});
+  return views;
+}
+
+// `count` views orbiting base.lookat at the height and distance of
+// base.lookfrom; nullopt for no views, like an empty views file.
+template <class T>
+[[nodiscard]] auto turntable(const CameraView<T>& base,
+                             const std::size_t count)
+    -> std::optional<std::vector<CameraView<T>>> {
+  if (count == 0)
+    return std::nullopt;
+  const auto offset = base.lookfrom - base.lookat;
+  const auto radius = std::hypot(offset.x(), offset.z());
+  const auto start = std::atan2(offset.z(), offset.x());
+  auto make_view = [&](auto k) {
+    const auto angle =
+        start + 2 * globals::pi<T> * static_cast<T>(k) / static_cast<T>(count);
+    return CameraView<T>{
+        .lookfrom = base.lookat + Vec3<T>{radius * std::cos(angle), offset.y(),
+                                          radius * std::sin(angle)},
+        .lookat = base.lookat,
+        .v_fov = base.v_fov};
+  };
+  auto views = std::vector<CameraView<T>>{};
+  std::ranges::for_each(
+      std::views::iota(std::size_t{0}, count) | std::views::transform(make_view),
+      [&views](auto&& view) { views.push_back(view); });
+  return views;
+}
+
+// Renders several views of one read-only scene. The tiles of every view go
+// into the pool up front, so workers move straight on to the next view
+// instead of idling at a per-image barrier.
+template <class T, class Image_t>
+class BatchRenderer {
+ public:
+  BatchRenderer() = delete;
+  BatchRenderer(ThreadPool& pool,
+                const HittableList<T>& world,
+                const CameraSettings<T, Image_t>& settings,
+                const Image_t& tile_size)
+      : m_pool(pool),
+        m_world(world),
+        m_settings(settings),
+        m_tile_size(tile_size) {};
+
+  [[nodiscard]] auto render(const std::vector<CameraView<T>>& views)
+      -> std::vector<Framebuffer<T, Image_t>>;
+
+ private:
+  ThreadPool& m_pool;
+  const HittableList<T>& m_world;
+  const CameraSettings<T, Image_t> m_settings;
+  const Image_t m_tile_size{};
+};
+
+template <class T, class Image_t>
+auto BatchRenderer<T, Image_t>::render(const std::vector<CameraView<T>>& views)
+    -> std::vector<Framebuffer<T, Image_t>> {
+  auto cameras = std::vector<Camera<T, Image_t>>{};
+  auto framebuffers = std::vector<Framebuffer<T, Image_t>>{};
+  cameras.reserve(views.size());
+  framebuffers.reserve(views.size());
+  for (const auto& view : views) {
+    cameras.push_back(
+        make_camera(m_settings, view.lookfrom, view.lookat, view.v_fov));
+    framebuffers.emplace_back(cameras.back().width(),
+                              cameras.back().height());
+  }
+
+  const auto start_time = std::chrono::high_resolution_clock::now();
+  auto tile_count = std::size_t{0};
+  for (auto v = std::size_t{0}; v < views.size(); ++v) {
+    const auto& camera = cameras[v];
+    auto& framebuffer = framebuffers[v];
+    for (const auto& tile :
+         make_tiles(camera.width(), camera.height(), m_tile_size)) {
+      m_pool.submit([this, &camera, &framebuffer, tile] {
+        camera.render_tile(m_world, tile, framebuffer);
+      });
+      ++tile_count;
+    }
+  }
+  m_pool.wait();
+  const auto end_time = std::chrono::high_resolution_clock::now();
+
+  std::clog << "batch: " << views.size() << " views, " << tile_count
+            << " tiles on " << m_pool.size() << " threads, took "
+            << std::chrono::duration<float>(end_time - start_time).count()
+            << " s\n";
+  return framebuffers;
+}
+
+#endif  // !BATCH_HPP
@@ -8,16 +8,27 @@
 #include <cstddef>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <ranges>
+#include <utility>
 #include <variant>
+#include <vector>
+#include "async_writer.hpp"
 #include "color.hpp"
+#include "environment_light.hpp"
 #include "fn_cpp_helper.hpp"
+#include "framebuffer.hpp"
 #include "globals.hpp"
 #include "hit_record.hpp"
 #include "hittable_list.hpp"
 #include "materials/material_t.hpp"
+#include "perf_counters.hpp"
+#include "radiance_cache.hpp"
 #include "ray.hpp"
+#include "render_stats.hpp"
+#include "tile_dependencies.hpp"
+#include "tiles.hpp"
 #include "vec3.hpp"
 #include "viewport.hpp"
 
@@ -33,18 +44,21 @@ class Camera {
                      const Vec3<T>& lookat,
                      const Vec3<T>& v_up,
                      const T& defocus_angle,
-                     const T& focus_distance)
+                     const T& focus_distance,
+                     const EnvironmentLight<T>& environment =
+                         EnvironmentLight<T>::sky(),
+                     std::shared_ptr<RadianceCache<T>> radiance_cache = {},
+                     const std::optional<T>& ambient_occlusion = {})
       : m_aspect_ratio(aspect_ratio),
         m_img_width(image_width),
         m_img_height(get_height(m_img_width, m_aspect_ratio)),
 
         m_samples_per_pixel(samples_per_pixel),
-        m_pixel_samples_scale(1. / static_cast<T>(m_samples_per_pixel)),
 
         m_v_fov(v_fov),
         m_focal_lenght((lookfrom - lookat).length()),
         m_theta(globals::degrees_to_radians(m_v_fov)),
-        m_h(std::tan(m_theta / 2.)),
+        m_h(std::tan(m_theta / 2)),
         m_viewport(Viewport<T>(m_img_width,
                                m_img_height,
                                2 * m_h * focus_distance,
@@ -53,39 +67,101 @@ class Camera {
                                v_up,
                                defocus_angle,
                                focus_distance)),
-        m_max_depth(max_depth) {}
+        m_max_depth(max_depth),
+        m_environment(environment),
+        m_radiance_cache(std::move(radiance_cache)),
+        m_ambient_occlusion(ambient_occlusion) {}
 
   auto render(const HittableList<T>& world) const noexcept -> void;
 
+  using Pixel_t = std::pair<Image_t, Image_t>;
+
+  [[nodiscard]] auto width() const noexcept -> Image_t { return m_img_width; }
+  [[nodiscard]] auto height() const noexcept -> Image_t {
+    return m_img_height;
+  }
+  [[nodiscard]] auto samples_per_pixel() const noexcept -> std::size_t {
+    return m_samples_per_pixel;
+  }
+  // Mean radiance of `samples` jittered paths through pixel {column, row}.
+  [[nodiscard]] auto pixel_color(const HittableList<T>& world,
+                                 const Pixel_t& pixel,
+                                 const std::size_t samples) const noexcept
+      -> Color<T>;
+  // First surface seen through the pixel center, without defocus.
+  [[nodiscard]] auto primary_hit(const HittableList<T>& world,
+                                 const Pixel_t& pixel) const noexcept
+      -> std::optional<HitRecord<T>>;
+  [[nodiscard]] auto project(const Point3<T>& p) const noexcept
+      -> std::optional<std::pair<T, T>> {
+    return m_viewport.project(p);
+  }
+  // sink(column, row, color) receives every pixel of the tile.
+  template <class PixelSink>
+  auto trace_tile(const HittableList<T>& world,
+                  const Tile<Image_t>& tile,
+                  PixelSink&& sink) const noexcept -> void;
+  auto render_tile(const HittableList<T>& world,
+                   const Tile<Image_t>& tile,
+                   Framebuffer<T, Image_t>& framebuffer) const noexcept
+      -> void {
+    trace_tile(world, tile, [&framebuffer](auto i, auto j, const auto& c) {
+      framebuffer.at(i, j) = c;
+    });
+  }
+
  private:
   template <class Ratio>
   [[nodiscard]] static constexpr auto get_height(const Image_t& width,
                                                  const Ratio& ratio)
       -> const Image_t;
+  // `bsdf_pdf` is the density the previous bounce sampled `ray` with, 0
+  // for camera rays and specular bounces, which the light cannot sample.
+  // `after_diffuse` paths may stop at a converged radiance cache cell.
   [[nodiscard]] auto ray_color(const Ray<T>& ray,
                                const int depth,
-                               const HittableList<T>& world) const noexcept
+                               const HittableList<T>& world,
+                               const T& bsdf_pdf,
+                               const bool after_diffuse) const noexcept
       -> Color<T>;
-  [[nodiscard]] auto backgound_color(const Vec3<T>& direction) const noexcept
-      -> const Color<T>;
+  // Whether the first surface `ray` sees is open within the
+  // m_ambient_occlusion radius along one cosine-weighted direction: white
+  // if so, black if not. Misses see the environment.
+  [[nodiscard]] auto ambient_occlusion(const Ray<T>& ray,
+                                       const HittableList<T>& world)
+      const noexcept -> Color<T>;
+  // Next event estimation: one environment sample, MIS-weighted against
+  // the material's own sampling.
+  [[nodiscard]] auto direct_light(const Ray<T>& ray,
+                                  const HitRecord<T>& hit_record,
+                                  const HittableList<T>& world) const noexcept
+      -> Color<T>;
+  [[nodiscard]] auto survival_probability(const Color<T>& weight,
+                                          const int depth) const noexcept -> T;
   [[nodiscard]] auto get_ray() const noexcept;
   [[nodiscard]] auto sample_square() const noexcept -> Vec3<T>;
   [[nodiscard]] auto defocus_disk_sample() const noexcept -> const Point3<T>;
   [[nodiscard]] auto material_scatter(
       const Ray<T>& ray,
       const HitRecord<T>& hit_record) const noexcept;
+  [[nodiscard]] auto material_eval(const Ray<T>& ray,
+                                   const HitRecord<T>& hit_record,
+                                   const Vec3<T>& direction) const noexcept;
 
   const T m_aspect_ratio{};
   const Image_t m_img_width{};
   const Image_t m_img_height{};
   const std::size_t m_samples_per_pixel{};
-  const T m_pixel_samples_scale{};
   const T m_v_fov{};
   const T m_focal_lenght{};
   const T m_theta{};
   const T m_h{};
   const Viewport<T> m_viewport{};
   const int m_max_depth{};
+  const EnvironmentLight<T> m_environment;
+  const std::shared_ptr<RadianceCache<T>> m_radiance_cache{};
+  // radius of the ambient occlusion preview; path traced if unset
+  const std::optional<T> m_ambient_occlusion{};
 };
 
 template <class T, class Image_t>
@@ -93,43 +169,40 @@ template <class Ratio>
 constexpr auto Camera<T, Image_t>::get_height(const Image_t& width,
                                               const Ratio& ratio)
     -> const Image_t {
-  const auto h = std::max(1., static_cast<Ratio>(width) / ratio);
+  const auto h = std::max(Ratio{1}, static_cast<Ratio>(width) / ratio);
   return static_cast<Image_t>(h);
 }
 
+// Rows are traced here and encoded and written by an AsyncRowWriter, so
+// tracing only waits on stdout when the writer falls a full queue behind.
 template <class T, class Image_t>
 auto Camera<T, Image_t>::render(const HittableList<T>& world) const noexcept
     -> void {
-  auto cout_color = write_color(std::cout);
-  auto lray_color = [this, &world](auto&& ray) {
-    return ray_color(ray, m_max_depth, world);
-  };
-  auto generate_color = [samples = m_samples_per_pixel,
-                         scale = m_pixel_samples_scale, make_ray = get_ray(),
-                         &lray_color](auto&& pair) {
-    auto lmake_ray = [&make_ray, &pair](auto) { return make_ray(pair); };
-    if (pair.first == 0 && pair.second % 5 == 0) {
-      std::clog << "Row: " << pair.second << "\n";
-    }
-    const auto pipe = std::views::iota(0u, samples) |
-                      std::views::transform(lmake_ray) |
-                      std::views::transform(lray_color);
-    const auto c =
-        std::ranges::fold_left(pipe, Color<T>{0, 0, 0}, std::plus<>());
-    return c * scale;
-  };
-
   const auto rows = std::views::iota(0u, m_img_height);
   const auto cols = std::views::iota(0u, m_img_width);
+  auto trace_row = [this, &world, &cols](auto row) {
+    if (row % 5 == 0) {
+      std::clog << "Row: " << row << "\n";
+    }
+    auto pixels = std::vector<Color<T>>{};
+    pixels.reserve(static_cast<std::size_t>(m_img_width));
+    std::ranges::for_each(cols, [&](auto column) {
+      pixels.push_back(
+          pixel_color(world, Pixel_t{column, row}, m_samples_per_pixel));
+    });
+    return pixels;
+  };
 
   std::clog << "===   START   ===\nnumber of rows: " << m_img_height << "\n"
             << std::flush;
   const auto start_time = std::chrono::high_resolution_clock::now();
 
-  std::cout << "P3\n" << m_img_width << ' ' << m_img_height << "\n255\n";
-  std::ranges::for_each(utiltools::cartesian_prod(rows, cols) |
-                            std::views::transform(generate_color),
-                        cout_color);
+  auto writer =
+      AsyncRowWriter<T>(std::cout, static_cast<std::size_t>(m_img_width),
+                        static_cast<std::size_t>(m_img_height));
+  std::ranges::for_each(rows | std::views::transform(trace_row),
+                        [&writer](auto&& row) { writer.push(std::move(row)); });
+  writer.finish();
 
   std::clog << "===   DONE    ===\n";
   const auto end_time = std::chrono::high_resolution_clock::now();
@@ -139,34 +212,194 @@ auto Camera<T, Image_t>::render(const HittableList<T>& world) const noexcept
   std::clog << "took: " << duration.count() << " min\n";
 }
 
+template <class T, class Image_t>
+auto Camera<T, Image_t>::pixel_color(const HittableList<T>& world,
+                                     const Pixel_t& pixel,
+                                     const std::size_t samples) const noexcept
+    -> Color<T> {
+  auto lray_color = [this, &world](auto&& ray) {
+    if (m_ambient_occlusion)
+      return ambient_occlusion(ray, world);
+    return ray_color(ray, m_max_depth, world, T{0}, false);
+  };
+  auto lmake_ray = [make_ray = get_ray(), &pixel](auto) {
+    const auto phase = perf::PhaseScope(perf::Phase::camera);
+    return make_ray(pixel);
+  };
+  const auto pipe = std::views::iota(std::size_t{0}, samples) |
+                    std::views::transform(lmake_ray) |
+                    std::views::transform(lray_color);
+  const auto c = std::ranges::fold_left(pipe, Color<T>{0, 0, 0}, std::plus<>());
+  render_stats::counters.paths += samples;
+  return c / static_cast<T>(samples);
+}
+
+template <class T, class Image_t>
+template <class PixelSink>
+auto Camera<T, Image_t>::trace_tile(const HittableList<T>& world,
+                                    const Tile<Image_t>& tile,
+                                    PixelSink&& sink) const noexcept -> void {
+  std::ranges::for_each(tile.pixels(), [&](auto&& pixel) {
+    sink(pixel.first, pixel.second,
+         pixel_color(world, pixel, m_samples_per_pixel));
+  });
+}
+
+template <class T, class Image_t>
+auto Camera<T, Image_t>::primary_hit(const HittableList<T>& world,
+                                     const Pixel_t& pixel) const noexcept
+    -> std::optional<HitRecord<T>> {
+  const auto i = static_cast<T>(pixel.first);
+  const auto j = static_cast<T>(pixel.second);
+  const auto pixel_center = m_viewport.pixel00_loc() +
+                            (i * m_viewport.pixel_du()) +
+                            (j * m_viewport.pixel_dv());
+  const auto origin = m_viewport.camera_center();
+  const auto cone = RayCone<T>{0, m_viewport.pixel_spread()};
+  return world.hit(Ray<T>{origin, pixel_center - origin, cone},
+                   Interval<T>{0, globals::infinity<T>});
+}
+
+// Power heuristic (beta = 2) weight of a sample drawn with density `pdf`
+// when `other_pdf` could also have produced it.
+template <class T>
+[[nodiscard]] auto power_heuristic(const T& pdf, const T& other_pdf) noexcept
+    -> T {
+  const auto a = pdf * pdf;
+  const auto b = other_pdf * other_pdf;
+  return a + b > 0 ? a / (a + b) : T{0};
+}
+
 template <class T, class Image_t>
 auto Camera<T, Image_t>::ray_color(const Ray<T>& ray,
                                    const int depth,
-                                   const HittableList<T>& world) const noexcept
+                                   const HittableList<T>& world,
+                                   const T& bsdf_pdf,
+                                   const bool after_diffuse) const noexcept
     -> Color<T> {
   if (depth <= 0)
-    return Color<T>{0., 0., 0.};
-
-  const auto inf_interval = Interval{0.001, globals::infinity<T>};
-  if (const auto hit_record = world.hit(ray, inf_interval)) {
-    if (const auto scattered = std::visit(
-            material_scatter(ray, hit_record.value()), hit_record->mat)) {
-      const auto [s_ray, attenuation] = scattered.value();
-      return attenuation * ray_color(s_ray, depth - 1, world);
-    }
-    return Color<T>{0., 0., 0.};
+    return Color<T>{0, 0, 0};
+
+  ++render_stats::counters.rays;
+  // Secondary rays start off the surface (HitRecord::spawn_ray), so no
+  // epsilon is needed here.
+  const auto inf_interval = Interval<T>{0, globals::infinity<T>};
+  const auto hit_record = [&] {
+    const auto phase = perf::PhaseScope(perf::Phase::intersection);
+    return world.hit(ray, inf_interval);
+  }();
+  if (!hit_record) {
+    // direct_light already counted what the light sampler could reach
+    const auto weight =
+        bsdf_pdf > 0
+            ? power_heuristic(bsdf_pdf, m_environment.pdf(ray.direction()))
+            : T{1};
+    return weight * m_environment.radiance(ray.direction());
+  }
+  dependencies::record(hit_record.value(), m_max_depth - depth);
+
+  // Only Lambertian radiance is the same from every direction.
+  const auto cached =
+      m_radiance_cache &&
+      std::holds_alternative<Lambertian<T>>(hit_record->mat);
+  if (cached && after_diffuse) {
+    if (const auto radiance =
+            m_radiance_cache->lookup(hit_record->p, hit_record->normal))
+      return radiance.value();
   }
 
-  return backgound_color(ray.direction());
+  // The light sample is half of the MIS pair whatever the BSDF sample
+  // does, so it is taken first and kept when that sample fails (a rough
+  // Metal microfacet below the horizon, say). Specular materials evaluate
+  // to a zero pdf and get nothing from it.
+  const auto direct = direct_light(ray, hit_record.value(), world);
+  const auto scattered = [&] {
+    const auto phase = perf::PhaseScope(perf::Phase::scatter);
+    return std::visit(material_scatter(ray, hit_record.value()),
+                      hit_record->mat);
+  }();
+  if (!scattered)
+    return direct;
+  const auto weight = scattered->weight(hit_record->normal);
+  const auto survival = survival_probability(weight, depth);
+  auto radiance = direct;
+  if (survival > 0 && globals::random_t<T>() < survival) {
+    const auto next_pdf = scattered->specular ? T{0} : scattered->pdf;
+    radiance += (weight / survival) *
+                ray_color(scattered->ray, depth - 1, world, next_pdf,
+                          after_diffuse || !scattered->specular);
+  }
+  if (cached)
+    m_radiance_cache->record(hit_record->p, hit_record->normal, radiance);
+  return radiance;
 }
 
 template <class T, class Image_t>
-auto Camera<T, Image_t>::backgound_color(
-    const Vec3<T>& direction) const noexcept -> const Color<T> {
-  const auto unit_direction = unit_vector<T>(direction);
-  const auto a = 0.5 * (unit_direction.y() + 1.);
-  const auto c = (1. - a) * Color<T>{1., 1., 1.} + a * Color<T>{0.5, 0.7, 1.0};
-  return c;
+auto Camera<T, Image_t>::direct_light(const Ray<T>& ray,
+                                      const HitRecord<T>& hit_record,
+                                      const HittableList<T>& world)
+    const noexcept -> Color<T> {
+  const auto light = m_environment.sample();
+  const auto cos_theta = dot(hit_record.normal, light.direction);
+  if (light.pdf <= 0 || cos_theta <= 0)
+    return Color<T>{0, 0, 0};
+  const auto [bsdf, pdf] = std::visit(
+      material_eval(ray, hit_record, light.direction), hit_record.mat);
+  if (pdf <= 0)
+    return Color<T>{0, 0, 0};
+
+  ++render_stats::counters.rays;
+  const auto shadow = hit_record.spawn_ray(light.direction);
+  const auto blocked = [&] {
+    const auto phase = perf::PhaseScope(perf::Phase::intersection);
+    return world.occluded(shadow, Interval<T>{0, globals::infinity<T>});
+  }();
+  if (blocked)
+    return Color<T>{0, 0, 0};
+  const auto weight = power_heuristic(light.pdf, pdf);
+  return (weight * cos_theta / light.pdf) * bsdf * light.radiance;
+}
+
+// Two rays per sample and no materials: the probe only asks whether
+// anything is in the way, so it is a HittableList::occluded query.
+template <class T, class Image_t>
+auto Camera<T, Image_t>::ambient_occlusion(const Ray<T>& ray,
+                                           const HittableList<T>& world)
+    const noexcept -> Color<T> {
+  ++render_stats::counters.rays;
+  const auto hit_record = [&] {
+    const auto phase = perf::PhaseScope(perf::Phase::intersection);
+    return world.hit(ray, Interval<T>{0, globals::infinity<T>});
+  }();
+  if (!hit_record)
+    return m_environment.radiance(ray.direction());
+  dependencies::record(hit_record.value(), 0);
+
+  auto direction = hit_record->normal + Vec3<T>::random_unit_vector();
+  if (direction.near_zero())
+    direction = hit_record->normal;
+  ++render_stats::counters.rays;
+  const auto probe = hit_record->spawn_ray(direction);
+  // t is in units of the unnormalized direction
+  const auto reach = m_ambient_occlusion.value() / direction.length();
+  const auto blocked = [&] {
+    const auto phase = perf::PhaseScope(perf::Phase::intersection);
+    return world.occluded(probe, Interval<T>{0, reach});
+  }();
+  return blocked ? Color<T>{0, 0, 0} : Color<T>{1, 1, 1};
+}
+
+// Russian roulette after the first few bounces: dim paths are terminated
+// early and the survivors reweighted, so the estimate stays unbiased.
+template <class T, class Image_t>
+auto Camera<T, Image_t>::survival_probability(const Color<T>& weight,
+                                              const int depth) const noexcept
+    -> T {
+  constexpr auto min_bounces = 3;
+  if (m_max_depth - depth < min_bounces)
+    return 1;
+  const auto max_component = std::max({weight.x(), weight.y(), weight.z()});
+  return std::clamp(max_component, T{0.05}, T{1});
 }
 
 template <class T, class Image_t>
@@ -182,13 +415,15 @@ auto Camera<T, Image_t>::get_ray() const noexcept {
                                 ? m_viewport.camera_center()
                                 : defocus_disk_sample();
     const auto ray_direction = pixel_sample - ray_origin;
-    return Ray<T>{ray_origin, ray_direction};
+    return Ray<T>{ray_origin, ray_direction,
+                  RayCone<T>{0, m_viewport.pixel_spread()}};
   };
 }
 
 template <class T, class Image_t>
 auto Camera<T, Image_t>::sample_square() const noexcept -> Vec3<T> {
-  return Vec3<T>(globals::random_t<T>() - 0.5, globals::random_t<T>() - 0.5, 0);
+  return Vec3<T>(globals::random_t<T>() - T{0.5},
+                 globals::random_t<T>() - T{0.5}, 0);
 }
 
 template <class T, class Image_t>
@@ -213,4 +448,48 @@ auto Camera<T, Image_t>::material_scatter(
   };
 }
 
+template <class T, class Image_t>
+auto Camera<T, Image_t>::material_eval(const Ray<T>& ray,
+                                       const HitRecord<T>& hit_record,
+                                       const Vec3<T>& direction)
+    const noexcept {
+  return overloaded{
+      [](std::monostate) { return BsdfEval_t<T>{}; },
+      [&](const auto& m) { return m.eval(ray, hit_record, direction); },
+  };
+}
+
+// Everything but the view itself, shared by the cameras of a batch or a
+// sequence.
+template <class T, class Image_t>
+struct CameraSettings {
+  Image_t image_width{};
+  T aspect_ratio{};
+  std::size_t samples_per_pixel{};
+  int max_depth{};
+  Vec3<T> v_up{};
+  T defocus_angle{};
+  T focus_distance{};
+  EnvironmentLight<T> environment = EnvironmentLight<T>::sky();
+  // shared by every camera of a batch or sequence; null renders without
+  std::shared_ptr<RadianceCache<T>> radiance_cache{};
+  // see Camera::ambient_occlusion
+  std::optional<T> ambient_occlusion{};
+};
+
+template <class T, class Image_t>
+[[nodiscard]] auto make_camera(const CameraSettings<T, Image_t>& settings,
+                               const Point3<T>& lookfrom,
+                               const Point3<T>& lookat,
+                               const T& v_fov) -> Camera<T, Image_t> {
+  return Camera<T, Image_t>{settings.image_width,   settings.aspect_ratio,
+                            settings.samples_per_pixel, settings.max_depth,
+                            v_fov,                  lookfrom,
+                            lookat,                 settings.v_up,
+                            settings.defocus_angle, settings.focus_distance,
+                            settings.environment,
+                            settings.radiance_cache,
+                            settings.ambient_occlusion};
+}
+
 #endif  // !CAMERA_HPP
@@ -0,0 +1,36 @@
+#ifndef CAMERA_KEYS_HPP
+#define CAMERA_KEYS_HPP
+
+#include <array>
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The text format shared by camera view and keyframe files: N numbers per
+// line, '#' starts a comment and blank lines are skipped. nullopt when a line
+// is short or malformed, or when no line carries numbers at all.
+template <class T, std::size_t N>
+[[nodiscard]] auto parse_key_lines(std::istream& in)
+    -> std::optional<std::vector<std::array<T, N>>> {
+  auto keys = std::vector<std::array<T, N>>{};
+  auto line = std::string{};
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    auto fields = std::istringstream(line);
+    auto& v = keys.emplace_back();
+    for (auto& x : v)
+      fields >> x;
+    if (!fields)
+      return std::nullopt;
+  }
+  if (keys.empty())
+    return std::nullopt;
+  return keys;
+}
+
+#endif  // !CAMERA_KEYS_HPP
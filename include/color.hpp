@@ -1,6 +1,7 @@
 #ifndef COLOR_HPP
 #define COLOR_HPP
 
+#include <array>
 #include <cmath>
 #include <cstdint>
 #include <functional>
@@ -44,4 +45,17 @@ inline auto write_color(std::ostream& out) {
   };
 }
 
+// The bytes write_color prints, for binary outputs.
+template <class T>
+[[nodiscard]] inline auto to_rgb8(const Color<T>& pixel_color) noexcept
+    -> std::array<std::uint8_t, 3> {
+  static const auto interval = Interval<double>{0., 0.999};
+  auto byte = [](T v) {
+    const auto gamma = static_cast<double>(linear_to_gamma(std::move(v)));
+    return static_cast<std::uint8_t>(256. * interval.clamp(gamma));
+  };
+  return {byte(pixel_color.x()), byte(pixel_color.y()),
+          byte(pixel_color.z())};
+}
+
 #endif  // !COLOR_HPP
@@ -0,0 +1,268 @@
+#ifndef ENVIRONMENT_LIGHT_HPP
+#define ENVIRONMENT_LIGHT_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "color.hpp"
+#include "globals.hpp"
+#include "vec3.hpp"
+
+// Radiance arriving from infinitely far away, stored as a lat-long image:
+// columns sweep the azimuth around +y, row 0 looks straight up. Pixels are
+// importance sampled in O(1) with an alias table built over
+// luminance * sin(theta), so a small bright sun gets the samples it needs
+// instead of being found only by chance.
+template <class T>
+class EnvironmentLight {
+ public:
+  struct Sample {
+    Vec3<T> direction{};
+    Color<T> radiance{};
+    // solid angle density of `direction`
+    T pdf{};
+  };
+
+  EnvironmentLight() = delete;
+  EnvironmentLight(const std::size_t width,
+                   const std::size_t height,
+                   std::vector<Color<T>> radiance)
+      : m_storage(build(width, height, std::move(radiance))) {};
+
+  // Portable float map (PF or Pf), the book's sky when no file is given.
+  [[nodiscard]] static auto load(const std::filesystem::path& path)
+      -> std::optional<EnvironmentLight>;
+  [[nodiscard]] static auto sky() -> EnvironmentLight;
+
+  [[nodiscard]] auto radiance(const Vec3<T>& direction) const noexcept
+      -> Color<T>;
+  [[nodiscard]] auto sample() const noexcept -> Sample;
+  [[nodiscard]] auto pdf(const Vec3<T>& direction) const noexcept -> T;
+
+ private:
+  // Vose's alias method: bin i keeps pixel i with probability `threshold`
+  // and hands the rest to `alias`.
+  struct Bin {
+    T threshold{};
+    std::uint32_t alias{};
+  };
+
+  struct Storage {
+    std::size_t width{};
+    std::size_t height{};
+    std::vector<Color<T>> radiance{};
+    // probability of picking each pixel, 0 everywhere for a black map
+    std::vector<T> probability{};
+    std::vector<Bin> bins{};
+  };
+
+  [[nodiscard]] static auto build(const std::size_t width,
+                                  const std::size_t height,
+                                  std::vector<Color<T>> radiance)
+      -> std::shared_ptr<const Storage>;
+  [[nodiscard]] auto pixel_of(const Vec3<T>& direction) const noexcept
+      -> std::size_t;
+  [[nodiscard]] auto pixel_pdf(const std::size_t pixel,
+                               const T& sin_theta) const noexcept -> T;
+
+  std::shared_ptr<const Storage> m_storage{};
+};
+
+template <class T>
+auto EnvironmentLight<T>::load(const std::filesystem::path& path)
+    -> std::optional<EnvironmentLight> {
+  auto file = std::ifstream(path, std::ios::binary);
+  auto magic = std::string{};
+  auto width = std::size_t{0};
+  auto height = std::size_t{0};
+  auto scale = 0.;
+  if (!(file >> magic >> width >> height >> scale) ||
+      (magic != "PF" && magic != "Pf") || width == 0 || height == 0 ||
+      scale == 0)
+    return std::nullopt;
+  file.get();
+
+  // Rows are stored bottom to top; a negative scale means little endian.
+  const auto channels = std::size_t{magic == "PF" ? 3u : 1u};
+  const auto swap =
+      (scale < 0) != (std::endian::native == std::endian::little);
+  auto row = std::vector<float>(width * channels);
+  auto radiance = std::vector<Color<T>>(width * height);
+  for (auto j = height; j-- > 0;) {
+    if (!file.read(reinterpret_cast<char*>(row.data()),
+                   static_cast<std::streamsize>(row.size() * sizeof(float))))
+      return std::nullopt;
+    auto value = [&](const std::size_t k) {
+      const auto f = swap ? std::bit_cast<float>(std::byteswap(
+                                std::bit_cast<std::uint32_t>(row[k])))
+                          : row[k];
+      return static_cast<T>(std::isfinite(f) ? std::max(f, 0.f) : 0.f);
+    };
+    for (auto i = std::size_t{0}; i < width; ++i) {
+      const auto k = i * channels;
+      radiance[j * width + i] =
+          channels == 3 ? Color<T>{value(k), value(k + 1), value(k + 2)}
+                        : Color<T>{value(k), value(k), value(k)};
+    }
+  }
+  return EnvironmentLight(width, height, std::move(radiance));
+}
+
+// The gradient the camera used to return for rays that miss, baked once.
+template <class T>
+auto EnvironmentLight<T>::sky() -> EnvironmentLight {
+  static const auto sky = [] {
+    constexpr auto width = std::size_t{8};
+    constexpr auto height = std::size_t{256};
+    auto radiance = std::vector<Color<T>>{};
+    radiance.reserve(width * height);
+    for (auto j = std::size_t{0}; j < height; ++j) {
+      const auto theta = (static_cast<T>(j) + T{0.5}) /
+                         static_cast<T>(height) * globals::pi<T>;
+      const auto a = T{0.5} * (std::cos(theta) + 1);
+      const auto c =
+          (1 - a) * Color<T>{1, 1, 1} + a * Color<T>{T{0.5}, T{0.7}, T{1}};
+      radiance.insert(radiance.end(), width, c);
+    }
+    return EnvironmentLight(width, height, std::move(radiance));
+  }();
+  return sky;
+}
+
+template <class T>
+auto EnvironmentLight<T>::radiance(const Vec3<T>& direction) const noexcept
+    -> Color<T> {
+  return m_storage->radiance[pixel_of(direction)];
+}
+
+template <class T>
+auto EnvironmentLight<T>::sample() const noexcept -> Sample {
+  const auto& s = *m_storage;
+  if (s.bins.empty())
+    return Sample{};
+  const auto n = static_cast<T>(s.bins.size());
+  const auto x = std::min(globals::random_t<T>() * n, std::nextafter(n, T{0}));
+  const auto bin = static_cast<std::size_t>(x);
+  const auto pixel = x - static_cast<T>(bin) < s.bins[bin].threshold
+                         ? bin
+                         : static_cast<std::size_t>(s.bins[bin].alias);
+
+  // uniform over the pixel's rectangle in (phi, theta)
+  const auto column = static_cast<T>(pixel % s.width);
+  const auto row = static_cast<T>(pixel / s.width);
+  const auto phi = (column + globals::random_t<T>()) /
+                       static_cast<T>(s.width) * 2 * globals::pi<T> -
+                   globals::pi<T>;
+  const auto theta = (row + globals::random_t<T>()) /
+                     static_cast<T>(s.height) * globals::pi<T>;
+  const auto sin_theta = std::sin(theta);
+  return Sample{.direction = Vec3<T>{sin_theta * std::cos(phi),
+                                     std::cos(theta),
+                                     sin_theta * std::sin(phi)},
+                .radiance = s.radiance[pixel],
+                .pdf = pixel_pdf(pixel, sin_theta)};
+}
+
+template <class T>
+auto EnvironmentLight<T>::pdf(const Vec3<T>& direction) const noexcept -> T {
+  const auto d = unit_vector(direction);
+  const auto sin_theta =
+      std::sqrt(std::max<T>(0, d.x() * d.x() + d.z() * d.z()));
+  return pixel_pdf(pixel_of(d), sin_theta);
+}
+
+// Pixel density over the (phi, theta) rectangle, 2pi^2 in area, turned
+// into solid angle by the sin(theta) of the lat-long mapping.
+template <class T>
+auto EnvironmentLight<T>::pixel_pdf(const std::size_t pixel,
+                                    const T& sin_theta) const noexcept -> T {
+  const auto& s = *m_storage;
+  if (s.bins.empty() || sin_theta <= 0)
+    return 0;
+  const auto pixels = static_cast<T>(s.width * s.height);
+  return s.probability[pixel] * pixels /
+         (2 * globals::pi<T> * globals::pi<T> * sin_theta);
+}
+
+template <class T>
+auto EnvironmentLight<T>::pixel_of(const Vec3<T>& direction) const noexcept
+    -> std::size_t {
+  const auto& s = *m_storage;
+  const auto d = unit_vector(direction);
+  const auto theta = std::acos(std::clamp<T>(d.y(), -1, 1));
+  const auto phi = std::atan2(d.z(), d.x()) + globals::pi<T>;
+  const auto column = std::min(
+      static_cast<std::size_t>(phi / (2 * globals::pi<T>) *
+                               static_cast<T>(s.width)),
+      s.width - 1);
+  const auto row = std::min(
+      static_cast<std::size_t>(theta / globals::pi<T> *
+                               static_cast<T>(s.height)),
+      s.height - 1);
+  return row * s.width + column;
+}
+
+template <class T>
+auto EnvironmentLight<T>::build(const std::size_t width,
+                                const std::size_t height,
+                                std::vector<Color<T>> radiance)
+    -> std::shared_ptr<const Storage> {
+  auto s = std::make_shared<Storage>(Storage{
+      .width = width, .height = height, .radiance = std::move(radiance)});
+  const auto n = width * height;
+  s->probability.resize(n);
+  auto total = T{0};
+  for (auto j = std::size_t{0}; j < height; ++j) {
+    const auto sin_theta = std::sin((static_cast<T>(j) + T{0.5}) /
+                                    static_cast<T>(height) * globals::pi<T>);
+    for (auto i = std::size_t{0}; i < width; ++i) {
+      const auto& c = s->radiance[j * width + i];
+      const auto luminance =
+          T{0.2126} * c.x() + T{0.7152} * c.y() + T{0.0722} * c.z();
+      s->probability[j * width + i] = luminance * sin_theta;
+      total += luminance * sin_theta;
+    }
+  }
+  if (total <= 0) {
+    std::ranges::fill(s->probability, T{0});
+    return s;
+  }
+
+  // Scaled so the mean is 1: bins under 1 are topped up by bins over 1.
+  s->bins.resize(n);
+  auto scaled = std::vector<T>(n);
+  auto small = std::vector<std::uint32_t>{};
+  auto large = std::vector<std::uint32_t>{};
+  for (auto k = std::size_t{0}; k < n; ++k) {
+    s->probability[k] /= total;
+    scaled[k] = s->probability[k] * static_cast<T>(n);
+    (scaled[k] < 1 ? small : large).push_back(static_cast<std::uint32_t>(k));
+  }
+  while (!small.empty() && !large.empty()) {
+    const auto lo = small.back();
+    const auto hi = large.back();
+    small.pop_back();
+    s->bins[lo] = Bin{.threshold = scaled[lo], .alias = hi};
+    scaled[hi] -= 1 - scaled[lo];
+    if (scaled[hi] < 1) {
+      large.pop_back();
+      small.push_back(hi);
+    }
+  }
+  // Leftovers are 1 up to rounding.
+  for (const auto k : large)
+    s->bins[k] = Bin{.threshold = 1, .alias = k};
+  for (const auto k : small)
+    s->bins[k] = Bin{.threshold = 1, .alias = k};
+  return s;
+}
+
+#endif  // !ENVIRONMENT_LIGHT_HPP
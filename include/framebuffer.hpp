@@ -0,0 +1,47 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include "color.hpp"
+
+template <class T, class Image_t>
+class Framebuffer {
+ public:
+  Framebuffer() = delete;
+  Framebuffer(const Image_t& width, const Image_t& height)
+      : m_width(width),
+        m_height(height),
+        m_pixels(static_cast<std::size_t>(width * height)) {};
+
+  [[nodiscard]] auto width() const noexcept -> Image_t { return m_width; }
+  [[nodiscard]] auto height() const noexcept -> Image_t { return m_height; }
+
+  [[nodiscard]] auto at(const Image_t& i, const Image_t& j) noexcept
+      -> Color<T>& {
+    return m_pixels[index(i, j)];
+  }
+  [[nodiscard]] auto at(const Image_t& i, const Image_t& j) const noexcept
+      -> const Color<T>& {
+    return m_pixels[index(i, j)];
+  }
+
+  auto write_ppm(std::ostream& out) const -> void {
+    out << "P3\n" << m_width << ' ' << m_height << "\n255\n";
+    std::ranges::for_each(m_pixels, write_color(out));
+  }
+
+ private:
+  [[nodiscard]] auto index(const Image_t& i, const Image_t& j) const noexcept
+      -> std::size_t {
+    return static_cast<std::size_t>(j * m_width + i);
+  }
+
+  Image_t m_width{};
+  Image_t m_height{};
+  std::vector<Color<T>> m_pixels{};
+};
+
+#endif  // !FRAMEBUFFER_HPP
@@ -1,14 +1,45 @@
 #ifndef GENERATE_DATA_HPP
 #define GENERATE_DATA_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
 #include "hit_record.hpp"
 #include "hittable_list.hpp"
+#include "hittables/compact_sphere_set.hpp"
+#include "hittables/instance_set.hpp"
+#include "hittables/sphere_grid.hpp"
+#include "transform.hpp"
 #include "vec3.hpp"
 
 template <class T>
 class DataGenerator {
  public:
+  // What add_feature_spheres adds, for callers reserving room for it.
+  static constexpr std::size_t feature_sphere_count = 4;
+
+  // The lattice covers [-extent, extent) on x and z; the book uses 11.
+  explicit DataGenerator(const int extent = 11) : m_extent(extent) {};
+
   [[nodiscard]] auto get_spheres() const noexcept -> HittableList<T>;
+  // Nullopt if the materials overflow the set's palette (see
+  // PaletteBuilder).
+  [[nodiscard]] auto get_compact_spheres() const noexcept
+      -> std::optional<CompactSphereSet<T>>;
+  [[nodiscard]] auto get_sphere_grid() const noexcept -> SphereGrid<T>;
+  [[nodiscard]] auto get_sphere_vector() const noexcept
+      -> std::vector<Sphere<T>>;
+  // The lattice as copies of one 4x4 block of spheres, each turned by a
+  // random angle; about a third of them get a new matte color.
+  [[nodiscard]] auto get_instanced_clusters() const noexcept
+      -> InstanceSet<T>;
+  // Ground plus the three large glass, matte and metal spheres.
+  auto add_feature_spheres(HittableList<T>& world,
+                           const Albedo_t<T>& matte_albedo =
+                               Color<T>{T{0.4}, T{0.2}, T{0.1}}) const noexcept
+      -> void;
 
  private:
   struct SphereData {
@@ -16,51 +47,152 @@ class DataGenerator {
     Material_t<T> material{};
   };
 
+  template <class Fn>
+  auto for_each_sphere(Fn&& fn) const noexcept -> void;
+  // Lattice points, an upper bound on the spheres kept around them.
+  [[nodiscard]] auto lattice_size() const noexcept -> std::size_t {
+    const auto side = static_cast<std::size_t>(2 * m_extent);
+    return side * side;
+  }
   [[nodiscard]] auto generate_material() const noexcept;
+
+  int m_extent{};
 };
 
 template <class T>
 auto DataGenerator<T>::get_spheres() const noexcept -> HittableList<T> {
   HittableList<T> world{};
+  world.reserve(lattice_size() + feature_sphere_count);
+  auto make_sphere = [](auto&& data) {
+    return Sphere<T>{data.center, T{0.2}, data.material};
+  };
+  for_each_sphere([&world, &make_sphere](auto&& data) {
+    world.add(make_sphere(data));
+  });
+  return world;
+}
+
+template <class T>
+auto DataGenerator<T>::get_sphere_grid() const noexcept -> SphereGrid<T> {
+  return SphereGrid<T>{get_sphere_vector()};
+}
+
+template <class T>
+auto DataGenerator<T>::get_sphere_vector() const noexcept
+    -> std::vector<Sphere<T>> {
+  auto spheres = std::vector<Sphere<T>>{};
+  spheres.reserve(lattice_size());
+  for_each_sphere([&spheres](auto&& data) {
+    spheres.push_back(Sphere<T>{data.center, T{0.2}, data.material});
+  });
+  return spheres;
+}
+
+// Same lattice packed into float32 spheres, with near-equal materials
+// sharing a palette entry.
+template <class T>
+auto DataGenerator<T>::get_compact_spheres() const noexcept
+    -> std::optional<CompactSphereSet<T>> {
+  auto palette = PaletteBuilder<T>{};
+  auto spheres = std::vector<PackedSphere>{};
+  spheres.reserve(lattice_size());
+  auto fits = true;
+  for_each_sphere([&palette, &spheres, &fits](auto&& sphere) {
+    const auto material =
+        fits ? palette.add(sphere.material, spheres) : std::nullopt;
+    if (!material) {
+      fits = false;
+      return;
+    }
+    spheres.push_back(PackedSphere{.x = static_cast<float>(sphere.center.x()),
+                                   .y = static_cast<float>(sphere.center.y()),
+                                   .z = static_cast<float>(sphere.center.z()),
+                                   .radius = 0.2f,
+                                   .material = material.value()});
+  });
+  if (!fits)
+    return std::nullopt;
+  return CompactSphereSet<T>{std::move(spheres),
+                             std::move(palette).materials()};
+}
+
+template <class T>
+auto DataGenerator<T>::get_instanced_clusters() const noexcept
+    -> InstanceSet<T> {
+  constexpr auto block = 4;
+  // 16 spheres always fit the palette
+  const auto cluster = std::make_shared<const Geometry_t<T>>(
+      DataGenerator<T>(block / 2).get_compact_spheres().value());
+  auto instances = std::vector<Instance<T>>{};
+  for (auto x = -m_extent; x < m_extent; x += block) {
+    for (auto z = -m_extent; z < m_extent; z += block) {
+      const auto yaw = globals::random_t<T>(0, 2 * globals::pi<T>);
+      const auto offset = Vec3<T>{static_cast<T>(x + block / 2), 0,
+                                  static_cast<T>(z + block / 2)};
+      auto instance = Instance<T>{
+          .geometry = cluster,
+          .transform =
+              Transform<T>::rotate_y(yaw).then(Transform<T>::translate(offset))};
+      if (globals::random_t<T>() < T{1} / 3)
+        instance.material =
+            Lambertian<T>{Color<T>::random() * Color<T>::random()};
+      instances.push_back(std::move(instance));
+    }
+  }
+  return InstanceSet<T>{std::move(instances)};
+}
+
+template <class T>
+auto DataGenerator<T>::add_feature_spheres(
+    HittableList<T>& world,
+    const Albedo_t<T>& matte_albedo) const noexcept -> void {
+  Material_t<T> ground_material =
+      Lambertian<T>(Color<T>{T{0.5}, T{0.5}, T{0.5}});
+  world.add(Sphere<T>{Point3<T>{0, -1000, 0}, 1000, ground_material});
+  Material_t<T> glass = Dielectric<T>{T{1.5}};
+  world.add(Sphere<T>{Point3<T>{0, 1, 0}, 1, glass});
+  Material_t<T> matte = Lambertian<T>{matte_albedo};
+  world.add(Sphere<T>{Point3<T>{-4, 1, 0}, 1, matte});
+  Material_t<T> metal = Metal<T>{Color<T>{T{0.7}, T{0.6}, T{0.5}}, 0};
+  world.add(Sphere<T>{Point3<T>{4, 1, 0}, 1, metal});
+}
+
+template <class T>
+template <class Fn>
+auto DataGenerator<T>::for_each_sphere(Fn&& fn) const noexcept -> void {
   auto random_axis = [](auto&& x) {
-    return static_cast<T>(x) + 0.9 * globals::random_t<T>();
+    return static_cast<T>(x) + T{0.9} * globals::random_t<T>();
   };
   auto make_center = [&random_axis](auto&& p) {
-    return Point3<T>{random_axis(p.first), 0.2, random_axis(p.second)};
+    return Point3<T>{random_axis(p.first), T{0.2}, random_axis(p.second)};
   };
   auto filter_center = [](const Vec3<T>& center) {
-    return (center - Point3<T>{4, 0.2, 0}).length() > 0.9;
-  };
-  auto make_sphere = [](auto&& data) {
-    return Sphere<T>{data.center, 0.2, data.material};
+    return (center - Point3<T>{4, T{0.2}, 0}).length() > T{0.9};
   };
   auto lgenerate_material = generate_material();
-  auto add_sphere = [&world](auto sphere) { world.add(sphere); };
 
-  const auto rows = std::views::iota(-11, 11);
-  const auto cols = std::views::iota(-11, 11);
+  const auto rows = std::views::iota(-m_extent, m_extent);
+  const auto cols = std::views::iota(-m_extent, m_extent);
   std::ranges::for_each(utiltools::cartesian_prod(rows, cols) |
                             std::views::transform(make_center) |
                             std::views::filter(filter_center) |
-                            std::views::transform(lgenerate_material) |
-                            std::views::transform(make_sphere),
-                        add_sphere);
-  return world;
+                            std::views::transform(lgenerate_material),
+                        fn);
 }
 
 template <class T>
 auto DataGenerator<T>::generate_material() const noexcept {
   return [](const Vec3<T>& center) {
     const auto r_mat = globals::random_t<T>();
-    if (r_mat < 0.7) {
+    if (r_mat < T{0.7}) {
       const auto albedo = Color<T>::random() * Color<T>::random();
       return SphereData{.center = center, .material = Lambertian<T>{albedo}};
-    } else if (r_mat < 0.9) {
-      const auto albedo = Color<T>::random(0.5, 1);
-      const auto fuzz = globals::random_t<T>(0, 0.5);
+    } else if (r_mat < T{0.9}) {
+      const auto albedo = Color<T>::random(T{0.5}, 1);
+      const auto fuzz = globals::random_t<T>(0, T{0.5});
       return SphereData{.center = center, .material = Metal<T>{albedo, fuzz}};
     }
-    return SphereData{.center = center, .material = Dielectric{0.5}};
+    return SphereData{.center = center, .material = Dielectric<T>{T{0.5}}};
   };
 }
 
@@ -16,20 +16,29 @@ template <class T>
 [[nodiscard]] inline auto degrees_to_radians(T&& degrees)
     -> std::remove_reference_t<T> {
   using U = std::remove_reference_t<T>;
-  return degrees * pi<U> / 180.;
+  return degrees * pi<U> / U{180};
+}
+
+// Bound on the relative error of n chained floating point operations
+// (Higham's gamma_n), used for conservative intersection error bounds.
+template <class T>
+[[nodiscard]] constexpr auto gamma(const int n) noexcept -> T {
+  constexpr auto machine_epsilon = std::numeric_limits<T>::epsilon() / 2;
+  return (static_cast<T>(n) * machine_epsilon) /
+         (1 - static_cast<T>(n) * machine_epsilon);
 }
 
 template <class T>
 inline auto random_t(const T& min, const T& max) -> T {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_real_distribution<T> dist(min, max);
+  thread_local std::random_device rd;
+  thread_local std::mt19937 gen(rd());
+  std::uniform_real_distribution<T> dist(min, max);
   return dist(gen);
 }
 
 template <class T>
 inline auto random_t() -> T {
-  return random_t<T>(0., 1.);
+  return random_t<T>(T{0}, T{1});
 }
 
 }  // namespace globals
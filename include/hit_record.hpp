@@ -1,7 +1,11 @@
 #ifndef HIT_RECORD_HPP
 #define HIT_RECORD_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <variant>
+#include "globals.hpp"
 #include "materials/dielectric.hpp"
 #include "materials/lambertian.hpp"
 #include "materials/metal.hpp"
@@ -19,12 +23,47 @@ struct HitRecord {
   Material_t<T> mat{};
   bool front_face{};
   Vec3<T> normal{};
+  // Absolute error bound of each component of p.
+  Vec3<T> p_error{};
+  // Surface parameterization and the ray footprint there, in world units
+  // (cone) and in uv units.
+  T u{};
+  T v{};
+  RayCone<T> cone{};
+  T uv_footprint{};
+  // Which object of the HittableList was hit, and which primitive inside
+  // it for the sets; what incremental re-rendering tracks.
+  std::uint32_t object{};
+  std::uint32_t primitive{};
 
   auto set_face_normal(const Ray<T>& ray,
                        const Vec3<T>& outward_normal) noexcept -> void {
     front_face = dot(ray.direction(), outward_normal) < 0;
     normal = front_face ? outward_normal : -outward_normal;
   }
+
+  // Ray leaving the surface towards `direction`. The origin is pushed just
+  // past the error bound of p along the normal, on the side the ray leaves
+  // by, so it cannot re-hit the surface it starts on for any precision of T.
+  // Rough lobes pass a `min_spread` so what they hit is looked up coarsely.
+  [[nodiscard]] auto spawn_ray(const Vec3<T>& direction,
+                               const T& min_spread = 0) const noexcept
+      -> Ray<T> {
+    const auto d = dot(abs(normal), p_error);
+    const auto offset = dot(direction, normal) < 0 ? -d * normal : d * normal;
+    const auto o = p + offset;
+    auto away = [](const T& x, const T& towards) {
+      if (towards > 0)
+        return std::nextafter(x, globals::infinity<T>);
+      if (towards < 0)
+        return std::nextafter(x, -globals::infinity<T>);
+      return x;
+    };
+    return Ray<T>{Point3<T>{away(o.x(), offset.x()), away(o.y(), offset.y()),
+                            away(o.z(), offset.z())},
+                  direction,
+                  RayCone<T>{cone.width, std::max(cone.spread, min_spread)}};
+  }
 };
 
 template <class T>
@@ -1,30 +1,73 @@
 #ifndef HITTABLE_LIST_HPP
 #define HITTABLE_LIST_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <optional>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 #include "hit_record.hpp"
+#include "hittables/compact_sphere_set.hpp"
+#include "hittables/instance_set.hpp"
 #include "hittables/sphere.hpp"
+#include "hittables/sphere_grid.hpp"
 #include "interval.hpp"
 #include "ray.hpp"
 
 template <class T>
-using Hittable_t = std::variant<Sphere<T>>;
+using Hittable_t = std::
+    variant<Sphere<T>, CompactSphereSet<T>, SphereGrid<T>, InstanceSet<T>>;
 
 template <class T>
 class HittableList {
  public:
   HittableList() {};
+  // Takes over `objects` and their storage, capacity included.
+  explicit HittableList(std::vector<Hittable_t<T>>&& objects) noexcept
+      : m_objects(std::move(objects)) {};
 
   auto add(const Hittable_t<T>& object) noexcept -> void;
+  auto add(Hittable_t<T>&& object) noexcept -> void;
+  // Room for `count` objects, so adding up to that many never reallocates
+  // (and so never copies the ones already added).
+  auto reserve(const std::size_t count) -> void { m_objects.reserve(count); }
   auto clear() noexcept -> void;
+  // For scene edits; callers re-render what `object` covered.
+  auto replace(const std::size_t index, const Hittable_t<T>& object) noexcept
+      -> void {
+    m_objects[index] = object;
+  }
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return m_objects.size();
+  }
+  [[nodiscard]] auto object(const std::size_t index) const noexcept
+      -> const Hittable_t<T>& {
+    return m_objects[index];
+  }
   [[nodiscard]] auto hit(const Ray<T>& ray,
                          const Interval<T>& ray_t) const noexcept
       -> const std::optional<HitRecord<T>>;
+  // Whether any object is hit in ray_t, e.g. for shadow rays: stops at the
+  // first hit and builds no HitRecord.
+  [[nodiscard]] auto occluded(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept
+      -> bool;
+  [[nodiscard]] auto primitive_count() const noexcept -> std::size_t;
+  [[nodiscard]] auto memory_bytes() const noexcept -> std::size_t;
+  // Deep copy, shared storage included, owned by the calling thread's node.
+  [[nodiscard]] auto replicate() const -> HittableList;
 
  private:
+  // The closest hit of an object, alternative by alternative.
+  using Closest_t = std::variant<typename Sphere<T>::Closest,
+                                 typename CompactSphereSet<T>::Closest,
+                                 typename SphereGrid<T>::Closest,
+                                 typename InstanceSet<T>::Closest>;
+
   std::vector<Hittable_t<T>> m_objects{};
 };
 
@@ -33,38 +76,113 @@ auto HittableList<T>::add(const Hittable_t<T>& object) noexcept -> void {
   m_objects.emplace_back(object);
 }
 
+template <class T>
+auto HittableList<T>::add(Hittable_t<T>&& object) noexcept -> void {
+  m_objects.emplace_back(std::move(object));
+}
+
 template <class T>
 auto HittableList<T>::clear() noexcept -> void {
   m_objects.clear();
 }
 
+// The loop keeps the closest hit each object's walk found, so the full
+// HitRecord (with its material copy) is built once, for the winning
+// object, without walking it again. The winner is only written on a hit,
+// so a list of many spheres does not copy it per object.
 template <class T>
 auto HittableList<T>::hit(const Ray<T>& ray,
                           const Interval<T>& ray_t) const noexcept
     -> const std::optional<HitRecord<T>> {
-  const auto make_hit_visitor = [&ray](const auto& closest) {
-    return overloaded{
-        [ray, closest](const Sphere<T>& sphere) {
-          return sphere.hit(ray, closest);
+  const Hittable_t<T>* winner = nullptr;
+  auto closest = Closest_t{};
+  auto t_max = ray_t.max();
+  for (const auto& obj : m_objects) {
+    std::visit(
+        [&](const auto& o) {
+          if (const auto c = o.closest(ray, Interval<T>(ray_t.min(), t_max))) {
+            winner = &obj;
+            closest = c.value();
+            t_max = c->t;
+          }
         },
-    };
+        obj);
+  }
+  if (!winner)
+    return std::nullopt;
+
+  auto make_record = [&ray, &closest](const auto& obj) {
+    using Closest = typename std::remove_cvref_t<decltype(obj)>::Closest;
+    return obj.record_for(ray, std::get<Closest>(closest));
+  };
+  auto record = std::visit(make_record, *winner);
+  record.object = static_cast<std::uint32_t>(winner - m_objects.data());
+  return record;
+}
+
+template <class T>
+auto HittableList<T>::occluded(const Ray<T>& ray,
+                               const Interval<T>& ray_t) const noexcept
+    -> bool {
+  auto occludes = [&ray, &ray_t](const auto& obj) {
+    return obj.occluded(ray, ray_t);
   };
+  return std::ranges::any_of(m_objects, [&occludes](const auto& obj) {
+    return std::visit(occludes, obj);
+  });
+}
 
-  struct Acc {
-    std::optional<HitRecord<T>> hr;
-    double c;
+template <class T>
+auto HittableList<T>::primitive_count() const noexcept -> std::size_t {
+  const auto count = overloaded{
+      [](const Sphere<T>&) -> std::size_t { return 1; },
+      [](const CompactSphereSet<T>& spheres) { return spheres.size(); },
+      [](const SphereGrid<T>& grid) { return grid.size(); },
+      [](const InstanceSet<T>& instances) {
+        return instances.primitive_count();
+      },
+  };
+  auto add_count = [&count](auto acc, const auto& obj) {
+    return acc + std::visit(count, obj);
   };
+  return std::ranges::fold_left(m_objects, std::size_t{0}, add_count);
+}
 
-  auto hit_closest = [&ray_t, &make_hit_visitor](auto&& acc, const auto& obj) {
-    const auto interval = Interval<T>(ray_t.min(), acc.c);
-    const auto hr = std::visit(make_hit_visitor(interval), obj);
-    return hr ? Acc{.hr = hr, .c = hr->t} : acc;
+// Heap and inline bytes held by the scene, for the per-primitive report.
+template <class T>
+auto HittableList<T>::memory_bytes() const noexcept -> std::size_t {
+  const auto external = overloaded{
+      [](const Sphere<T>&) -> std::size_t { return 0; },
+      [](const CompactSphereSet<T>& spheres) {
+        return spheres.memory_bytes() - sizeof(spheres);
+      },
+      [](const SphereGrid<T>& grid) {
+        return grid.memory_bytes() - sizeof(grid);
+      },
+      [](const InstanceSet<T>& instances) {
+        return instances.memory_bytes() - sizeof(instances);
+      },
   };
+  auto add_bytes = [&external](auto acc, const auto& obj) {
+    return acc + std::visit(external, obj);
+  };
+  return std::ranges::fold_left(m_objects,
+                                sizeof(*this) + m_objects.capacity() *
+                                                    sizeof(Hittable_t<T>),
+                                add_bytes);
+}
 
-  const auto init = Acc{.hr = std::nullopt, .c = ray_t.max()};
-  const auto res =
-      std::ranges::fold_left(m_objects, std::move(init), hit_closest);
-  return res.hr;
+template <class T>
+auto HittableList<T>::replicate() const -> HittableList {
+  const auto copy = overloaded{
+      [](const Sphere<T>& sphere) -> Hittable_t<T> { return sphere; },
+      [](const auto& set) -> Hittable_t<T> { return set.replicate(); },
+  };
+  auto replica = HittableList{};
+  replica.m_objects.reserve(m_objects.size());
+  for (const auto& obj : m_objects)
+    replica.m_objects.push_back(std::visit(copy, obj));
+  return replica;
 }
 
 #endif  // !HITTABLE_LIST_HPP
@@ -0,0 +1,603 @@
+#ifndef COMPACT_SPHERE_SET_HPP
+#define COMPACT_SPHERE_SET_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include "aabb.hpp"
+#include "color.hpp"
+#include "fn_cpp_helper.hpp"
+#include "globals.hpp"
+#include "hit_record.hpp"
+#include "hittables/sphere.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+#include "tile_dependencies.hpp"
+
+// 20 bytes per primitive instead of a Sphere<double> with an inline
+// material variant.
+struct PackedSphere {
+  float x{};
+  float y{};
+  float z{};
+  float radius{};
+  std::uint16_t material{};
+};
+
+// Bounds are stored as 16-bit offsets on a grid spanning the whole set,
+// rounded outwards so they stay conservative. Inner nodes keep the right
+// child index (the left child follows the node), leaves keep the primitive
+// count in the top 4 bits and the first primitive in the rest.
+struct QuantizedNode {
+  std::array<std::uint16_t, 3> lo{};
+  std::array<std::uint16_t, 3> hi{};
+  std::uint32_t payload{};
+};
+static_assert(sizeof(QuantizedNode) == 16);
+
+// Stand-in for all spheres under a BVH node, matte in their area-weighted
+// mean albedo. A ray through the node's box takes it as hit with the
+// probability that it would hit one of the spheres if they were scattered
+// at random in the box: 1 - exp(-a / A), with a their summed
+// `cross_section` and A the box's projected area along the ray. Sparse
+// clusters keep their brightness whatever their shape, and dense ones
+// their self-occlusion. The hit is at the box entry, so the tree culls it
+// like the spheres.
+struct LodProxy {
+  float cross_section{};
+  std::array<float, 3> albedo{};
+};
+static_assert(sizeof(LodProxy) == 16);
+
+template <class T>
+class CompactSphereSet {
+ public:
+  static constexpr std::size_t max_materials = 1u << 16;
+  static constexpr std::size_t max_primitives = 1u << 28;
+
+  CompactSphereSet() = delete;
+  CompactSphereSet(std::vector<PackedSphere> spheres,
+                   std::vector<Material_t<T>> materials)
+      : m_storage(build(std::move(spheres), std::move(materials))) {};
+
+  [[nodiscard]] auto hit(const Ray<T>& ray,
+                         const Interval<T>& ray_t) const noexcept
+      -> const std::optional<HitRecord<T>>;
+  [[nodiscard]] auto hit_distance(const Ray<T>& ray,
+                                  const Interval<T>& ray_t) const noexcept
+      -> std::optional<T>;
+  // Whether anything is hit in ray_t; stops at the first hit found.
+  [[nodiscard]] auto occluded(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept -> bool {
+    return closest(ray, ray_t, true).has_value();
+  }
+
+  struct Closest {
+    std::uint32_t index{};
+    T t{};
+    // index is then the node whose proxy was hit
+    bool proxy{};
+  };
+
+  // The nearest hit in ray_t, which record_for turns into its HitRecord
+  // without walking the tree again. With `any_hit`, the first hit found
+  // rather than the nearest.
+  [[nodiscard]] auto closest(const Ray<T>& ray,
+                             const Interval<T>& ray_t,
+                             const bool any_hit = false) const noexcept
+      -> std::optional<Closest>;
+  [[nodiscard]] auto record_for(const Ray<T>& ray,
+                                const Closest& c) const noexcept
+      -> HitRecord<T>;
+
+  [[nodiscard]] auto bounding_box() const noexcept -> Aabb<T> {
+    return m_storage->bounds;
+  }
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return m_storage->spheres.size();
+  }
+  [[nodiscard]] auto memory_bytes() const noexcept -> std::size_t {
+    const auto& s = *m_storage;
+    return sizeof(*this) + sizeof(Storage) +
+           s.spheres.capacity() * sizeof(PackedSphere) +
+           s.nodes.capacity() * sizeof(QuantizedNode) +
+           s.materials.capacity() * sizeof(Material_t<T>) +
+           (m_lod ? sizeof(Lod) + m_lod->proxies.capacity() * sizeof(LodProxy)
+                  : 0);
+  }
+  // Copies share the storage; a replica owns a copy of it, allocated and
+  // first touched by the calling thread (and so on its NUMA node).
+  [[nodiscard]] auto replicate() const -> CompactSphereSet {
+    auto replica = *this;
+    replica.m_storage = std::make_shared<const Storage>(*m_storage);
+    if (m_lod)
+      replica.m_lod = std::make_shared<const Lod>(*m_lod);
+    return replica;
+  }
+  // A copy sharing the spheres that traces clusters narrower than `error`
+  // ray footprints as their LodProxy, e.g. 1 for clusters under a pixel
+  // wide. Proxies cost 16 bytes per BVH node, about 8 per sphere.
+  [[nodiscard]] auto with_lod(const T& error) const -> CompactSphereSet;
+
+ private:
+  static constexpr std::uint32_t leaf_size = 4;
+  static constexpr std::uint32_t count_shift = 28;
+  static constexpr std::uint32_t index_mask = (1u << count_shift) - 1;
+  static constexpr T quant_steps = 65535;
+
+  // Shared and immutable once built, so copies of the set (and the
+  // Hittable_t variant holding it) stay pointer sized.
+  struct Storage {
+    std::vector<PackedSphere> spheres{};
+    std::vector<Material_t<T>> materials{};
+    std::vector<QuantizedNode> nodes{};
+    Aabb<T> bounds{};
+    Vec3<T> cell{};
+  };
+
+  // One proxy per node, by node index.
+  struct Lod {
+    std::vector<LodProxy> proxies{};
+    T error{};
+  };
+
+  [[nodiscard]] static auto build(std::vector<PackedSphere> spheres,
+                                  std::vector<Material_t<T>> materials) noexcept
+      -> std::shared_ptr<const Storage>;
+  static auto build_node(Storage& s,
+                         const std::size_t begin,
+                         const std::size_t end) noexcept -> void;
+  // What build_proxies sums up a subtree to.
+  struct Cluster {
+    T cross_section{};
+    // albedo times cross section
+    Color<T> albedo{};
+  };
+
+  // Fills `proxies` for the subtree at `index`, children first.
+  static auto build_proxies(const Storage& s,
+                            std::vector<LodProxy>& proxies,
+                            const std::size_t index) noexcept -> Cluster;
+  [[nodiscard]] auto proxy_hit(const Ray<T>& ray,
+                               const std::uint32_t index,
+                               const Aabb<T>& box) const noexcept -> bool;
+  [[nodiscard]] static auto box_of(const PackedSphere& s) noexcept -> Aabb<T>;
+  [[nodiscard]] static auto quantize(const Storage& s,
+                                     const Aabb<T>& box) noexcept
+      -> QuantizedNode;
+  [[nodiscard]] static auto dequantize(const Storage& s,
+                                       const QuantizedNode& node) noexcept
+      -> Aabb<T>;
+  [[nodiscard]] static auto center_of(const PackedSphere& s) noexcept
+      -> Point3<T> {
+    return Point3<T>{static_cast<T>(s.x), static_cast<T>(s.y),
+                     static_cast<T>(s.z)};
+  }
+
+  std::shared_ptr<const Storage> m_storage{};
+  std::shared_ptr<const Lod> m_lod{};
+};
+
+template <class T>
+auto CompactSphereSet<T>::hit(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept
+    -> const std::optional<HitRecord<T>> {
+  const auto c = closest(ray, ray_t);
+  if (!c)
+    return std::nullopt;
+  return record_for(ray, c.value());
+}
+
+template <class T>
+auto CompactSphereSet<T>::record_for(const Ray<T>& ray,
+                                    const Closest& c) const noexcept
+    -> HitRecord<T> {
+  if (c.proxy) {
+    const auto& p = m_lod->proxies[c.index];
+    // At the box entry, facing away from the box center. Rays leaving it
+    // start inside the proxy's sphere and so see the spheres themselves,
+    // which shadow and occlude it as they would each other.
+    const auto center =
+        dequantize(*m_storage, m_storage->nodes[c.index]).centroid();
+    auto hr = Sphere<T>::make_record(
+        center, (ray.at(c.t) - center).length(),
+        Lambertian<T>{Color<T>{static_cast<T>(p.albedo[0]),
+                               static_cast<T>(p.albedo[1]),
+                               static_cast<T>(p.albedo[2])}},
+        ray, c.t);
+    // Stands for every sphere under the node. Proxies are not tracked per
+    // node, so a tile that saw one re-renders on edits to any sphere.
+    hr.primitive = dependencies::TileDependencies::any_primitive;
+    return hr;
+  }
+  const auto& s = m_storage->spheres[c.index];
+  auto hr = Sphere<T>::make_record(center_of(s), static_cast<T>(s.radius),
+                                   m_storage->materials[s.material], ray,
+                                   c.t);
+  hr.primitive = static_cast<std::uint32_t>(c.index);
+  return hr;
+}
+
+template <class T>
+auto CompactSphereSet<T>::hit_distance(const Ray<T>& ray,
+                                       const Interval<T>& ray_t) const noexcept
+    -> std::optional<T> {
+  const auto c = closest(ray, ray_t);
+  return c ? std::optional(c->t) : std::nullopt;
+}
+
+template <class T>
+auto CompactSphereSet<T>::closest(const Ray<T>& ray,
+                                  const Interval<T>& ray_t,
+                                  const bool any_hit) const noexcept
+    -> std::optional<Closest> {
+  const auto& storage = *m_storage;
+  if (storage.nodes.empty())
+    return std::nullopt;
+
+  const auto inv_direction = inverse(ray.direction());
+  auto stack = std::array<std::uint32_t, 64>{};
+  auto top = std::size_t{0};
+  stack[top++] = 0;
+
+  // Clusters narrower than `error` footprints are traced as their proxy,
+  // unless the ray starts inside the proxy's sphere. sqrt(3) times the
+  // longest side of a node's box bounds the sphere's diameter; the
+  // footprint is taken at the box center and compared squared, so there
+  // is no sqrt per node.
+  const auto lod_scale = m_lod ? T{1.7320508} / m_lod->error : T{0};
+  const auto& cone = ray.cone();
+  const auto spread_squared = cone.spread * cone.spread;
+  auto use_proxy = [&](const Aabb<T>& box) {
+    const auto e = box.extent();
+    const auto size = lod_scale * std::max({e.x(), e.y(), e.z()}) - cone.width;
+    const auto distance_squared =
+        (box.centroid() - ray.origin()).length_squared();
+    return (size <= 0 || size * size < spread_squared * distance_squared) &&
+           4 * distance_squared > e.length_squared();
+  };
+
+  auto result = std::optional<Closest>{};
+  auto t_max = ray_t.max();
+  while (top > 0) {
+    const auto index = stack[--top];
+    const auto& node = storage.nodes[index];
+    const auto interval = Interval<T>(ray_t.min(), t_max);
+    const auto box = dequantize(storage, node);
+    const auto entry = box.hit(ray, inv_direction, interval);
+    if (!entry)
+      continue;
+    if (lod_scale > 0 && use_proxy(box)) {
+      if (proxy_hit(ray, index, box)) {
+        t_max = entry.value();
+        result = Closest{.index = index, .t = t_max, .proxy = true};
+        if (any_hit)
+          return result;
+      }
+      continue;
+    }
+
+    const auto count = node.payload >> count_shift;
+    if (count == 0) {
+      stack[top++] = node.payload;
+      stack[top++] = index + 1;
+      continue;
+    }
+    const auto first = node.payload & index_mask;
+    for (auto i = first; i < first + count; ++i) {
+      const auto& s = storage.spheres[i];
+      const auto root =
+          Sphere<T>::intersect(center_of(s), static_cast<T>(s.radius), ray,
+                               Interval<T>(ray_t.min(), t_max));
+      if (root) {
+        t_max = root.value();
+        result = Closest{.index = i, .t = t_max};
+        if (any_hit)
+          return result;
+      }
+    }
+  }
+  return result;
+}
+
+// Proxies are built over the existing tree, so the spheres are shared.
+template <class T>
+auto CompactSphereSet<T>::with_lod(const T& error) const -> CompactSphereSet {
+  auto lod = std::make_shared<Lod>(Lod{.error = error});
+  if (!m_storage->nodes.empty()) {
+    lod->proxies.resize(m_storage->nodes.size());
+    build_proxies(*m_storage, lod->proxies, 0);
+  }
+  auto copy = *this;
+  copy.m_lod = std::move(lod);
+  return copy;
+}
+
+template <class T>
+auto CompactSphereSet<T>::build_proxies(const Storage& s,
+                                        std::vector<LodProxy>& proxies,
+                                        const std::size_t index) noexcept
+    -> Cluster {
+  const auto& node = s.nodes[index];
+  const auto count = node.payload >> count_shift;
+  auto cluster = Cluster{.albedo = Color<T>{0, 0, 0}};
+  if (count == 0) {
+    const auto left = build_proxies(s, proxies, index + 1);
+    const auto right = build_proxies(s, proxies, node.payload);
+    cluster = Cluster{.cross_section = left.cross_section + right.cross_section,
+                      .albedo = left.albedo + right.albedo};
+  } else {
+    const auto mean_albedo = overloaded{
+        [](const Lambertian<T>& m) { return m.mean_albedo(); },
+        [](const Metal<T>& m) { return m.mean_albedo(); },
+        [](const Dielectric<T>&) { return Color<T>{1, 1, 1}; },
+        [](const std::monostate&) { return Color<T>{0, 0, 0}; },
+    };
+    const auto first = node.payload & index_mask;
+    for (const auto& p : std::span(s.spheres).subspan(first, count)) {
+      const auto r = static_cast<T>(p.radius);
+      const auto area = globals::pi<T> * r * r;
+      cluster.cross_section += area;
+      cluster.albedo += area * std::visit(mean_albedo, s.materials[p.material]);
+    }
+  }
+
+  const auto albedo = cluster.cross_section > 0
+                          ? cluster.albedo / cluster.cross_section
+                          : cluster.albedo;
+  proxies[index] = LodProxy{
+      .cross_section = static_cast<float>(cluster.cross_section),
+      .albedo = {static_cast<float>(albedo.x()),
+                 static_cast<float>(albedo.y()),
+                 static_cast<float>(albedo.z())}};
+  return cluster;
+}
+
+// The coverage test hashes the ray and the node, so hit_distance and hit
+// agree on the same ray.
+template <class T>
+auto CompactSphereSet<T>::proxy_hit(const Ray<T>& ray,
+                                    const std::uint32_t index,
+                                    const Aabb<T>& box) const noexcept -> bool {
+  const auto& p = m_lod->proxies[index];
+  const auto d = abs(unit_vector(ray.direction()));
+  const auto e = box.extent();
+  const auto projected =
+      d.x() * e.y() * e.z() + d.y() * e.x() * e.z() + d.z() * e.x() * e.y();
+  auto h = std::uint64_t{index} * 0x9e3779b97f4a7c15;
+  for (const auto v : {ray.origin().x(), ray.origin().y(), ray.origin().z(),
+                       ray.direction().x(), ray.direction().y(),
+                       ray.direction().z()}) {
+    h ^= std::bit_cast<std::uint64_t>(static_cast<double>(v));
+    h = (h ^ (h >> 31)) * 0xbf58476d1ce4e5b9;
+  }
+  h ^= h >> 29;
+  const auto u = static_cast<T>(h >> 40) / static_cast<T>(1u << 24);
+  const auto coverage =
+      T{1} - std::exp(-static_cast<T>(p.cross_section) / projected);
+  return u < coverage;
+}
+
+template <class T>
+auto CompactSphereSet<T>::build(std::vector<PackedSphere> spheres,
+                                std::vector<Material_t<T>> materials) noexcept
+    -> std::shared_ptr<const Storage> {
+  auto s = std::make_shared<Storage>(
+      Storage{.spheres = std::move(spheres), .materials = std::move(materials)});
+  if (s->spheres.empty() || s->spheres.size() > max_primitives)
+    return s;
+  const auto bounds = std::ranges::fold_left(
+      s->spheres, Aabb<T>{},
+      [](const auto& acc, const auto& p) { return acc.merge(box_of(p)); });
+  // one spare cell on each side absorbs rounding when dequantizing
+  s->cell = bounds.extent() / (quant_steps - 2);
+  s->bounds = Aabb<T>{bounds.min() - s->cell, bounds.max() + s->cell};
+  s->nodes.reserve(2 * s->spheres.size() / leaf_size + 1);
+  build_node(*s, 0, s->spheres.size());
+  s->nodes.shrink_to_fit();
+  return s;
+}
+
+// Median split on the longest centroid axis; nodes are laid out depth first.
+template <class T>
+auto CompactSphereSet<T>::build_node(Storage& s,
+                                     const std::size_t begin,
+                                     const std::size_t end) noexcept -> void {
+  const auto range = std::span(s.spheres).subspan(begin, end - begin);
+  const auto box = std::ranges::fold_left(
+      range, Aabb<T>{},
+      [](const auto& acc, const auto& p) { return acc.merge(box_of(p)); });
+  const auto index = s.nodes.size();
+  s.nodes.push_back(quantize(s, box));
+
+  if (range.size() <= leaf_size) {
+    s.nodes[index].payload =
+        static_cast<std::uint32_t>(range.size() << count_shift) |
+        static_cast<std::uint32_t>(begin);
+    return;
+  }
+
+  const auto centroids = std::ranges::fold_left(
+      range, Aabb<T>{},
+      [](const auto& acc, const auto& p) { return acc.merge(center_of(p)); });
+  const auto a = centroids.longest_axis();
+  const auto half = range.size() / 2;
+  std::ranges::nth_element(
+      range, range.begin() + static_cast<std::ptrdiff_t>(half), {},
+      [a](const auto& p) { return axis(center_of(p), a); });
+
+  build_node(s, begin, begin + half);
+  s.nodes[index].payload = static_cast<std::uint32_t>(s.nodes.size());
+  build_node(s, begin + half, end);
+}
+
+template <class T>
+auto CompactSphereSet<T>::box_of(const PackedSphere& s) noexcept -> Aabb<T> {
+  const auto r = static_cast<T>(s.radius);
+  const auto c = center_of(s);
+  return Aabb<T>{c - Vec3<T>{r, r, r}, c + Vec3<T>{r, r, r}};
+}
+
+template <class T>
+auto CompactSphereSet<T>::quantize(const Storage& s,
+                                   const Aabb<T>& box) noexcept
+    -> QuantizedNode {
+  auto to_grid = [&s](const Point3<T>& p, auto&& round) {
+    auto q = std::array<std::uint16_t, 3>{};
+    for (auto a = 0; a < 3; ++a) {
+      const auto cell = axis(s.cell, a);
+      const auto v =
+          cell > 0 ? round((axis(p, a) - axis(s.bounds.min(), a)) / cell)
+                   : T{0};
+      q[static_cast<std::size_t>(a)] =
+          static_cast<std::uint16_t>(std::clamp<T>(v, 0, quant_steps));
+    }
+    return q;
+  };
+  return QuantizedNode{
+      .lo = to_grid(box.min(), [](T v) { return std::floor(v) - 1; }),
+      .hi = to_grid(box.max(), [](T v) { return std::ceil(v) + 1; }),
+      .payload = 0};
+}
+
+template <class T>
+auto CompactSphereSet<T>::dequantize(const Storage& s,
+                                     const QuantizedNode& node) noexcept
+    -> Aabb<T> {
+  const auto& o = s.bounds.min();
+  auto at = [&s, &o](const auto& q) {
+    return Point3<T>{o.x() + static_cast<T>(q[0]) * s.cell.x(),
+                     o.y() + static_cast<T>(q[1]) * s.cell.y(),
+                     o.z() + static_cast<T>(q[2]) * s.cell.z()};
+  };
+  return Aabb<T>{at(node.lo), at(node.hi)};
+}
+
+// Kind and parameters of `material`, each rounded to `bits` bits; nullopt
+// for textured materials, which never share an entry.
+template <class T>
+[[nodiscard]] auto material_key(const Material_t<T>& material,
+                                const int bits) noexcept
+    -> std::optional<std::uint64_t> {
+  const auto levels = static_cast<T>((1 << bits) - 1);
+  auto key = static_cast<std::uint64_t>(material.index());
+  auto add = [&key, bits, levels](const T& v) {
+    const auto level = std::lround(std::clamp<T>(v, 0, 1) * levels);
+    key = (key << bits) | static_cast<std::uint64_t>(level);
+  };
+  auto add_color = [&add](const std::optional<Color<T>>& color) {
+    if (!color)
+      return false;
+    add(color->x());
+    add(color->y());
+    add(color->z());
+    return true;
+  };
+  const auto keyed = std::visit(
+      overloaded{[](const std::monostate&) { return true; },
+                 [&](const Lambertian<T>& m) {
+                   return add_color(m.constant_albedo());
+                 },
+                 [&](const Metal<T>& m) {
+                   if (!add_color(m.constant_albedo()))
+                     return false;
+                   add(m.fuzz());
+                   return true;
+                 },
+                 [&](const Dielectric<T>& m) {
+                   add(m.refraction_index() / 4);
+                   return true;
+                 }},
+      material);
+  return keyed ? std::optional(key) : std::nullopt;
+}
+
+// Deduplicates the materials of a compact set as its spheres are packed,
+// into at most max_materials entries. Materials of one kind whose
+// parameters round to the same key share the entry of the first of them.
+// Rounding starts at 8 bits and drops a bit each time the palette
+// overflows, down to 4: small scenes keep their materials to display
+// precision, large random ones merge colors a few percent apart. A drop
+// merges the entries kept so far by their own keys and renumbers the
+// spheres already packed, so the scene is never buffered.
+template <class T>
+class PaletteBuilder {
+ public:
+  // The entry of the next sphere's `material`; `packed` holds the spheres
+  // so far and is renumbered if the rounding drops. Nullopt if even 4
+  // bits leave too many entries.
+  [[nodiscard]] auto add(const Material_t<T>& material,
+                         std::span<PackedSphere> packed)
+      -> std::optional<std::uint16_t>;
+  [[nodiscard]] auto materials() && -> std::vector<Material_t<T>> {
+    return std::move(m_materials);
+  }
+
+ private:
+  static constexpr int min_bits = 4;
+
+  [[nodiscard]] auto coarsen(std::span<PackedSphere> packed) -> bool;
+
+  int m_bits{8};
+  std::vector<Material_t<T>> m_materials{};
+  std::unordered_map<std::uint64_t, std::uint16_t> m_entries{};
+};
+
+template <class T>
+auto PaletteBuilder<T>::add(const Material_t<T>& material,
+                            std::span<PackedSphere> packed)
+    -> std::optional<std::uint16_t> {
+  while (true) {
+    const auto key = material_key<T>(material, m_bits);
+    if (const auto entry = key ? m_entries.find(key.value()) : m_entries.end();
+        entry != m_entries.end())
+      return entry->second;
+    if (m_materials.size() < CompactSphereSet<T>::max_materials) {
+      const auto index = static_cast<std::uint16_t>(m_materials.size());
+      m_materials.push_back(material);
+      if (key)
+        m_entries.emplace(key.value(), index);
+      return index;
+    }
+    if (!coarsen(packed))
+      return std::nullopt;
+  }
+}
+
+template <class T>
+auto PaletteBuilder<T>::coarsen(std::span<PackedSphere> packed) -> bool {
+  if (m_bits == min_bits)
+    return false;
+  --m_bits;
+  auto materials = std::vector<Material_t<T>>{};
+  auto renumbered = std::vector<std::uint16_t>(m_materials.size());
+  m_entries.clear();
+  for (auto i = std::size_t{0}; i < m_materials.size(); ++i) {
+    const auto key = material_key<T>(m_materials[i], m_bits);
+    if (const auto entry = key ? m_entries.find(key.value()) : m_entries.end();
+        entry != m_entries.end()) {
+      renumbered[i] = entry->second;
+      continue;
+    }
+    const auto index = static_cast<std::uint16_t>(materials.size());
+    materials.push_back(std::move(m_materials[i]));
+    renumbered[i] = index;
+    if (key)
+      m_entries.emplace(key.value(), index);
+  }
+  m_materials = std::move(materials);
+  for (auto& sphere : packed)
+    sphere.material = renumbered[sphere.material];
+  return true;
+}
+
+#endif  // !COMPACT_SPHERE_SET_HPP
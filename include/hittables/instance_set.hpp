@@ -0,0 +1,384 @@
+#ifndef INSTANCE_SET_HPP
+#define INSTANCE_SET_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "aabb.hpp"
+#include "fn_cpp_helper.hpp"
+#include "hit_record.hpp"
+#include "hittables/compact_sphere_set.hpp"
+#include "hittables/sphere.hpp"
+#include "hittables/sphere_grid.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+#include "transform.hpp"
+
+// What an instance can point at. Instances do not nest.
+template <class T>
+using Geometry_t = std::variant<Sphere<T>, CompactSphereSet<T>, SphereGrid<T>>;
+// The nearest hit inside one, alternative by alternative.
+template <class T>
+using GeometryClosest_t = std::variant<typename Sphere<T>::Closest,
+                                       typename CompactSphereSet<T>::Closest,
+                                       typename SphereGrid<T>::Closest>;
+
+// One placement of shared geometry: object space is mapped to the world by
+// `transform`, and `material`, when set, replaces the geometry's own.
+template <class T>
+struct Instance {
+  std::shared_ptr<const Geometry_t<T>> geometry{};
+  Transform<T> transform{};
+  std::optional<Material_t<T>> material{};
+};
+
+// Many placements of a few shared objects, e.g. a forest of one tree. The
+// set keeps only the instances and a BVH over their world bounds; every
+// geometry is stored once, however often it is placed. Rays reaching an
+// instance are taken into its object space, where distances stay the same
+// because the direction is not renormalized.
+template <class T>
+class InstanceSet {
+ public:
+  InstanceSet() = delete;
+  explicit InstanceSet(std::vector<Instance<T>> instances)
+      : m_storage(build(std::move(instances))) {};
+
+  [[nodiscard]] auto hit(const Ray<T>& ray,
+                         const Interval<T>& ray_t) const noexcept
+      -> const std::optional<HitRecord<T>>;
+  [[nodiscard]] auto hit_distance(const Ray<T>& ray,
+                                  const Interval<T>& ray_t) const noexcept
+      -> std::optional<T>;
+  // Any hit in ray_t; the first instance that reports one ends the walk.
+  [[nodiscard]] auto occluded(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept -> bool {
+    return closest(ray, ray_t, true).has_value();
+  }
+
+  // The instance hit and the geometry's own nearest hit inside it.
+  struct Closest {
+    std::uint32_t index{};
+    T t{};
+    GeometryClosest_t<T> geometry{};
+  };
+
+  // The nearest hit in ray_t, which record_for turns into its HitRecord
+  // without walking the instances or the geometry again. With `any_hit`,
+  // the first instance found occluding, at t_max and with no geometry
+  // hit.
+  [[nodiscard]] auto closest(const Ray<T>& ray,
+                             const Interval<T>& ray_t,
+                             const bool any_hit = false) const noexcept
+      -> std::optional<Closest>;
+  [[nodiscard]] auto record_for(const Ray<T>& ray,
+                                const Closest& c) const noexcept
+      -> HitRecord<T>;
+
+  [[nodiscard]] auto bounding_box() const noexcept -> Aabb<T> {
+    return m_storage->nodes.empty() ? Aabb<T>{} : m_storage->nodes[0].box;
+  }
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return m_storage->instances.size();
+  }
+  // Primitives as rendered, i.e. counted once per instance.
+  [[nodiscard]] auto primitive_count() const noexcept -> std::size_t;
+  // Shared geometry is counted once.
+  [[nodiscard]] auto memory_bytes() const noexcept -> std::size_t;
+  // Copies share the storage; a replica owns a copy of it and of each
+  // geometry, allocated and first touched by the calling thread.
+  [[nodiscard]] auto replicate() const -> InstanceSet;
+
+ private:
+  static constexpr std::uint32_t leaf_size = 2;
+
+  // Inner nodes (count 0) keep the right child in `index`, the left one
+  // follows the node; leaves keep their first instance.
+  struct Node {
+    Aabb<T> box{};
+    std::uint32_t index{};
+    std::uint32_t count{};
+  };
+
+  struct Storage {
+    std::vector<Instance<T>> instances{};
+    std::vector<Node> nodes{};
+  };
+
+  [[nodiscard]] static auto build(std::vector<Instance<T>> instances)
+      -> std::shared_ptr<const Storage>;
+  static auto build_node(Storage& s,
+                         std::span<const Aabb<T>> boxes,
+                         std::vector<std::uint32_t>& order,
+                         const std::size_t begin,
+                         const std::size_t end) -> void;
+  [[nodiscard]] static auto object_ray(const Instance<T>& instance,
+                                       const Ray<T>& ray,
+                                       const bool with_cone) noexcept
+      -> Ray<T>;
+  [[nodiscard]] static auto world_box(const Instance<T>& instance) noexcept
+      -> Aabb<T>;
+
+  std::shared_ptr<const Storage> m_storage{};
+};
+
+template <class T>
+auto InstanceSet<T>::hit(const Ray<T>& ray,
+                         const Interval<T>& ray_t) const noexcept
+    -> const std::optional<HitRecord<T>> {
+  const auto c = closest(ray, ray_t);
+  if (!c)
+    return std::nullopt;
+  return record_for(ray, c.value());
+}
+
+// The geometry's record is built from its own closest hit, in object
+// space with the footprint; the normal was already flipped against that
+// ray, and the inverse transpose keeps the orientation, so front_face
+// carries over.
+template <class T>
+auto InstanceSet<T>::record_for(const Ray<T>& ray,
+                                const Closest& c) const noexcept
+    -> HitRecord<T> {
+  const auto& instance = m_storage->instances[c.index];
+  const auto local = object_ray(instance, ray, true);
+  auto hr = std::visit(
+      [&local, &c](const auto& g) {
+        using Closest_t = typename std::remove_cvref_t<decltype(g)>::Closest;
+        return g.record_for(local, std::get<Closest_t>(c.geometry));
+      },
+      *instance.geometry);
+  const auto& transform = instance.transform;
+  hr.p_error = transform.point_error(hr.p, hr.p_error);
+  hr.p = transform.point(hr.p);
+  hr.normal = unit_vector(transform.normal(hr.normal));
+  hr.cone = RayCone<T>{
+      ray.cone().width_at(hr.t * ray.direction().length()), ray.cone().spread};
+  if (instance.material)
+    hr.mat = instance.material.value();
+  hr.primitive = c.index;
+  return hr;
+}
+
+template <class T>
+auto InstanceSet<T>::hit_distance(const Ray<T>& ray,
+                                  const Interval<T>& ray_t) const noexcept
+    -> std::optional<T> {
+  const auto c = closest(ray, ray_t);
+  return c ? std::optional(c->t) : std::nullopt;
+}
+
+template <class T>
+auto InstanceSet<T>::closest(const Ray<T>& ray,
+                             const Interval<T>& ray_t,
+                             const bool any_hit) const noexcept
+    -> std::optional<Closest> {
+  const auto& storage = *m_storage;
+  if (storage.nodes.empty())
+    return std::nullopt;
+
+  const auto inv_direction = inverse(ray.direction());
+  auto stack = std::array<std::uint32_t, 64>{};
+  auto top = std::size_t{0};
+  stack[top++] = 0;
+
+  auto result = std::optional<Closest>{};
+  auto t_max = ray_t.max();
+  while (top > 0) {
+    const auto index = stack[--top];
+    const auto& node = storage.nodes[index];
+    if (!node.box.hit(ray, inv_direction, Interval<T>(ray_t.min(), t_max)))
+      continue;
+
+    if (node.count == 0) {
+      stack[top++] = node.index;
+      stack[top++] = index + 1;
+      continue;
+    }
+    for (auto i = node.index; i < node.index + node.count; ++i) {
+      const auto& instance = storage.instances[i];
+      const auto local = object_ray(instance, ray, !any_hit);
+      const auto interval = Interval<T>(ray_t.min(), t_max);
+      if (any_hit) {
+        const auto occluded = std::visit(
+            [&local, &interval](const auto& g) {
+              return g.occluded(local, interval);
+            },
+            *instance.geometry);
+        if (occluded)
+          return Closest{.index = i, .t = t_max};
+        continue;
+      }
+      const auto hit = std::visit(
+          [&local, &interval](const auto& g) {
+            const auto c = g.closest(local, interval);
+            return c ? std::optional<GeometryClosest_t<T>>(c.value())
+                     : std::nullopt;
+          },
+          *instance.geometry);
+      if (hit) {
+        t_max = std::visit([](const auto& c) { return c.t; }, hit.value());
+        result = Closest{.index = i, .t = t_max, .geometry = hit.value()};
+      }
+    }
+  }
+  return result;
+}
+
+// Only nearest hits need the footprint, for the geometry's level of detail
+// and the record: its width shrinks with the instance's scale so object
+// space footprints, and the uv footprints derived from them, stay right;
+// spread is an angle.
+template <class T>
+auto InstanceSet<T>::object_ray(const Instance<T>& instance,
+                                const Ray<T>& ray,
+                                const bool with_cone) noexcept -> Ray<T> {
+  const auto to_object = instance.transform.inverse();
+  const auto cone =
+      with_cone ? RayCone<T>{ray.cone().width /
+                                 instance.transform.scale_factor(),
+                             ray.cone().spread}
+                : RayCone<T>{};
+  return Ray<T>{to_object.point(ray.origin()),
+                to_object.vector(ray.direction()), cone};
+}
+
+template <class T>
+auto InstanceSet<T>::world_box(const Instance<T>& instance) noexcept
+    -> Aabb<T> {
+  const auto box = std::visit([](const auto& g) { return g.bounding_box(); },
+                              *instance.geometry);
+  auto world = Aabb<T>{};
+  for (auto corner = 0; corner < 8; ++corner)
+    world = world.merge(instance.transform.point(
+        Point3<T>{(corner & 1) ? box.max().x() : box.min().x(),
+                  (corner & 2) ? box.max().y() : box.min().y(),
+                  (corner & 4) ? box.max().z() : box.min().z()}));
+  return world;
+}
+
+template <class T>
+auto InstanceSet<T>::build(std::vector<Instance<T>> instances)
+    -> std::shared_ptr<const Storage> {
+  auto s = std::make_shared<Storage>();
+  std::erase_if(instances, [](const auto& i) { return !i.geometry; });
+  if (instances.empty())
+    return s;
+
+  auto boxes = std::vector<Aabb<T>>{};
+  boxes.reserve(instances.size());
+  for (const auto& instance : instances)
+    boxes.push_back(world_box(instance));
+  auto order = std::vector<std::uint32_t>(instances.size());
+  for (auto i = std::size_t{0}; i < order.size(); ++i)
+    order[i] = static_cast<std::uint32_t>(i);
+
+  s->nodes.reserve(2 * instances.size() / leaf_size + 1);
+  build_node(*s, boxes, order, 0, order.size());
+  s->instances.reserve(instances.size());
+  for (const auto i : order)
+    s->instances.push_back(std::move(instances[i]));
+  return s;
+}
+
+// Median split on the longest centroid axis; nodes are laid out depth
+// first and leaves index the instances in their final order.
+template <class T>
+auto InstanceSet<T>::build_node(Storage& s,
+                                std::span<const Aabb<T>> boxes,
+                                std::vector<std::uint32_t>& order,
+                                const std::size_t begin,
+                                const std::size_t end) -> void {
+  const auto range = std::span(order).subspan(begin, end - begin);
+  const auto box = std::ranges::fold_left(
+      range, Aabb<T>{},
+      [&boxes](const auto& acc, auto i) { return acc.merge(boxes[i]); });
+  const auto index = s.nodes.size();
+  s.nodes.push_back(Node{.box = box});
+
+  if (range.size() <= leaf_size) {
+    s.nodes[index].index = static_cast<std::uint32_t>(begin);
+    s.nodes[index].count = static_cast<std::uint32_t>(range.size());
+    return;
+  }
+
+  const auto centroids = std::ranges::fold_left(
+      range, Aabb<T>{}, [&boxes](const auto& acc, auto i) {
+        return acc.merge(boxes[i].centroid());
+      });
+  const auto a = centroids.longest_axis();
+  const auto half = range.size() / 2;
+  std::ranges::nth_element(
+      range, range.begin() + static_cast<std::ptrdiff_t>(half), {},
+      [&boxes, a](auto i) { return axis(boxes[i].centroid(), a); });
+
+  build_node(s, boxes, order, begin, begin + half);
+  s.nodes[index].index = static_cast<std::uint32_t>(s.nodes.size());
+  build_node(s, boxes, order, begin + half, end);
+}
+
+template <class T>
+auto InstanceSet<T>::primitive_count() const noexcept -> std::size_t {
+  const auto count = overloaded{
+      [](const Sphere<T>&) -> std::size_t { return 1; },
+      [](const auto& set) { return set.size(); },
+  };
+  auto add_count = [&count](auto acc, const auto& instance) {
+    return acc + std::visit(count, *instance.geometry);
+  };
+  return std::ranges::fold_left(m_storage->instances, std::size_t{0},
+                                add_count);
+}
+
+template <class T>
+auto InstanceSet<T>::memory_bytes() const noexcept -> std::size_t {
+  const auto external = overloaded{
+      [](const Sphere<T>&) -> std::size_t { return 0; },
+      [](const auto& set) { return set.memory_bytes() - sizeof(set); },
+  };
+  const auto& s = *m_storage;
+  auto bytes = sizeof(*this) + sizeof(Storage) +
+               s.instances.capacity() * sizeof(Instance<T>) +
+               s.nodes.capacity() * sizeof(Node);
+  auto geometries = std::vector<const Geometry_t<T>*>{};
+  for (const auto& instance : s.instances)
+    geometries.push_back(instance.geometry.get());
+  std::ranges::sort(geometries);
+  const auto unique = std::ranges::unique(geometries);
+  geometries.erase(unique.begin(), unique.end());
+  for (const auto* geometry : geometries)
+    bytes += sizeof(Geometry_t<T>) + std::visit(external, *geometry);
+  return bytes;
+}
+
+template <class T>
+auto InstanceSet<T>::replicate() const -> InstanceSet {
+  const auto copy = overloaded{
+      [](const Sphere<T>& sphere) -> Geometry_t<T> { return sphere; },
+      [](const auto& set) -> Geometry_t<T> { return set.replicate(); },
+  };
+  auto copies = std::map<const Geometry_t<T>*,
+                         std::shared_ptr<const Geometry_t<T>>>{};
+  auto storage = std::make_shared<Storage>(*m_storage);
+  for (auto& instance : storage->instances) {
+    auto& replica = copies[instance.geometry.get()];
+    if (!replica)
+      replica = std::make_shared<const Geometry_t<T>>(
+          std::visit(copy, *instance.geometry));
+    instance.geometry = replica;
+  }
+  auto set = *this;
+  set.m_storage = std::move(storage);
+  return set;
+}
+
+#endif  // !INSTANCE_SET_HPP
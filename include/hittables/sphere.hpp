@@ -1,7 +1,11 @@
 #ifndef SPHERE_HPP
 #define SPHERE_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <optional>
+#include <utility>
+#include "aabb.hpp"
 #include "hit_record.hpp"
 #include "interval.hpp"
 #include "ray.hpp"
@@ -18,10 +22,60 @@ class Sphere {
   [[nodiscard]] auto hit(const Ray<T> ray,
                          const Interval<T>& ray_t) const noexcept
       -> const std::optional<HitRecord<T>> {
-    const auto oc = m_center - ray.origin();
+    const auto root = intersect(m_center, m_radius, ray, ray_t);
+    if (!root)
+      return std::nullopt;
+    return make_record(m_center, m_radius, m_material, ray, root.value());
+  }
+
+  [[nodiscard]] auto hit_distance(const Ray<T>& ray,
+                                  const Interval<T>& ray_t) const noexcept
+      -> std::optional<T> {
+    return intersect(m_center, m_radius, ray, ray_t);
+  }
+  // The nearest hit and its record in two steps, as for the sets, whose
+  // record_for builds the record without walking them again.
+  struct Closest {
+    T t{};
+  };
+  [[nodiscard]] auto closest(const Ray<T>& ray,
+                             const Interval<T>& ray_t) const noexcept
+      -> std::optional<Closest> {
+    const auto t = intersect(m_center, m_radius, ray, ray_t);
+    return t ? std::optional(Closest{.t = t.value()}) : std::nullopt;
+  }
+  [[nodiscard]] auto record_for(const Ray<T>& ray,
+                                const Closest& c) const noexcept
+      -> HitRecord<T> {
+    return make_record(m_center, m_radius, m_material, ray, c.t);
+  }
+  [[nodiscard]] auto occluded(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept -> bool {
+    return intersect(m_center, m_radius, ray, ray_t).has_value();
+  }
+
+  [[nodiscard]] auto center() const noexcept -> const Point3<T>& {
+    return m_center;
+  }
+  [[nodiscard]] auto radius() const noexcept -> const T& { return m_radius; }
+  [[nodiscard]] auto material() const noexcept -> const Material_t<T>& {
+    return m_material;
+  }
+  [[nodiscard]] auto bounding_box() const noexcept -> Aabb<T> {
+    const auto r = Vec3<T>{m_radius, m_radius, m_radius};
+    return Aabb<T>{m_center - r, m_center + r};
+  }
+
+  // Nearest root inside ray_t, shared with the packed sphere containers.
+  [[nodiscard]] static auto intersect(const Point3<T>& center,
+                                      const T& radius,
+                                      const Ray<T>& ray,
+                                      const Interval<T>& ray_t) noexcept
+      -> std::optional<T> {
+    const auto oc = center - ray.origin();
     const auto a = ray.direction().length_squared();
     const auto h = dot(ray.direction(), oc);
-    const auto c = oc.length_squared() - m_radius * m_radius;
+    const auto c = oc.length_squared() - radius * radius;
     const auto disciminant = h * h - a * c;
     if (disciminant < 0)
       return std::nullopt;
@@ -34,14 +88,47 @@ class Sphere {
         return std::nullopt;
       }
     }
+    return root;
+  }
 
-    const auto p = ray.at(root);
-    const auto outward_normal = (p - m_center) / m_radius;
-    auto hr = HitRecord<T>{.t = root, .p = p, .mat = m_material};
+  [[nodiscard]] static auto make_record(const Point3<T>& center,
+                                        const T& radius,
+                                        const Material_t<T>& material,
+                                        const Ray<T>& ray,
+                                        const T& root) noexcept
+      -> HitRecord<T> {
+    // Reprojecting onto the surface keeps the error of p independent of the
+    // ray length.
+    const auto offset = ray.at(root) - center;
+    const auto on_surface = offset * (radius / offset.length());
+    const auto p = center + on_surface;
+    const auto outward_normal = on_surface / radius;
+    const auto [u, v] = uv(outward_normal);
+    const auto cone = RayCone<T>{
+        ray.cone().width_at(root * ray.direction().length()),
+        ray.cone().spread};
+    auto hr = HitRecord<T>{
+        .t = root,
+        .p = p,
+        .mat = material,
+        .p_error = globals::gamma<T>(6) * abs(on_surface) +
+                   globals::gamma<T>(1) * abs(center),
+        .u = u,
+        .v = v,
+        .cone = cone,
+        .uv_footprint = cone.width / (2 * globals::pi<T> * radius)};
     hr.set_face_normal(ray, outward_normal);
     return hr;
   }
 
+  // Longitude and latitude of a point on the unit sphere, both in [0, 1];
+  // v = 0 at y = -1.
+  [[nodiscard]] static auto uv(const Vec3<T>& p) noexcept -> std::pair<T, T> {
+    const auto theta = std::acos(std::clamp<T>(-p.y(), -1, 1));
+    const auto phi = std::atan2(-p.z(), p.x()) + globals::pi<T>;
+    return {phi / (2 * globals::pi<T>), theta / globals::pi<T>};
+  }
+
  private:
   Point3<T> m_center;
   T m_radius;
@@ -0,0 +1,305 @@
+#ifndef SPHERE_GRID_HPP
+#define SPHERE_GRID_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "aabb.hpp"
+#include "hit_record.hpp"
+#include "hittables/sphere.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+
+// Uniform grid over spheres of similar size spread evenly through their
+// bounds (particles, crowds, the book's lattice). Building is two linear
+// passes, and rays walk the cells front to back with a 3D-DDA, so they
+// stop at the first cell that holds a hit.
+template <class T>
+class SphereGrid {
+ public:
+  // Target primitives per cell, and a cap on cells per axis.
+  static constexpr T density = 3;
+  static constexpr std::size_t max_resolution = 512;
+
+  SphereGrid() = delete;
+  explicit SphereGrid(std::vector<Sphere<T>> spheres)
+      : m_storage(build(std::move(spheres))) {};
+
+  [[nodiscard]] auto hit(const Ray<T>& ray,
+                         const Interval<T>& ray_t) const noexcept
+      -> const std::optional<HitRecord<T>>;
+  [[nodiscard]] auto hit_distance(const Ray<T>& ray,
+                                  const Interval<T>& ray_t) const noexcept
+      -> std::optional<T>;
+  // Any hit in ray_t ends the walk, not only one in the nearest cell.
+  [[nodiscard]] auto occluded(const Ray<T>& ray,
+                              const Interval<T>& ray_t) const noexcept -> bool {
+    return closest(ray, ray_t, true).has_value();
+  }
+
+  struct Closest {
+    std::uint32_t index{};
+    T t{};
+  };
+
+  // The nearest hit in ray_t, which record_for turns into its HitRecord
+  // without walking the grid again. With `any_hit`, the first hit found
+  // rather than the nearest.
+  [[nodiscard]] auto closest(const Ray<T>& ray,
+                             const Interval<T>& ray_t,
+                             const bool any_hit = false) const noexcept
+      -> std::optional<Closest>;
+  [[nodiscard]] auto record_for(const Ray<T>& ray,
+                                const Closest& c) const noexcept
+      -> HitRecord<T> {
+    const auto& s = m_storage->spheres[c.index];
+    auto hr =
+        Sphere<T>::make_record(s.center(), s.radius(), s.material(), ray, c.t);
+    hr.primitive = c.index;
+    return hr;
+  }
+
+  [[nodiscard]] auto bounding_box() const noexcept -> Aabb<T> {
+    return m_storage->bounds;
+  }
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return m_storage->spheres.size();
+  }
+  [[nodiscard]] auto resolution() const noexcept
+      -> const std::array<std::size_t, 3>& {
+    return m_storage->resolution;
+  }
+  [[nodiscard]] auto memory_bytes() const noexcept -> std::size_t {
+    const auto& s = *m_storage;
+    return sizeof(*this) + sizeof(Storage) +
+           s.spheres.capacity() * sizeof(Sphere<T>) +
+           (s.cell_start.capacity() + s.indices.capacity()) *
+               sizeof(std::uint32_t);
+  }
+  // Copies share the storage; a replica owns a copy of it, allocated and
+  // first touched by the calling thread (and so on its NUMA node).
+  [[nodiscard]] auto replicate() const -> SphereGrid {
+    auto replica = *this;
+    replica.m_storage = std::make_shared<const Storage>(*m_storage);
+    return replica;
+  }
+
+ private:
+  // Cell c holds indices[cell_start[c] .. cell_start[c + 1]).
+  struct Storage {
+    std::vector<Sphere<T>> spheres{};
+    std::vector<std::uint32_t> cell_start{};
+    std::vector<std::uint32_t> indices{};
+    Aabb<T> bounds{};
+    std::array<std::size_t, 3> resolution{};
+    Vec3<T> cell_size{};
+  };
+
+  [[nodiscard]] static auto build(std::vector<Sphere<T>> spheres) noexcept
+      -> std::shared_ptr<const Storage>;
+  [[nodiscard]] static auto choose_resolution(const Aabb<T>& bounds,
+                                              const std::size_t count) noexcept
+      -> std::array<std::size_t, 3>;
+  // Inclusive range of cells overlapped by `box` on every axis.
+  [[nodiscard]] static auto cell_range(const Storage& s,
+                                       const Aabb<T>& box) noexcept
+      -> std::array<std::array<std::size_t, 3>, 2>;
+  [[nodiscard]] static auto cell_of(const Storage& s,
+                                    const T& x,
+                                    const int a) noexcept -> std::size_t;
+  [[nodiscard]] static auto flat_index(const Storage& s,
+                                       const std::array<std::size_t, 3>& c)
+      noexcept -> std::size_t {
+    return (c[2] * s.resolution[1] + c[1]) * s.resolution[0] + c[0];
+  }
+
+  std::shared_ptr<const Storage> m_storage{};
+};
+
+template <class T>
+auto SphereGrid<T>::hit(const Ray<T>& ray,
+                        const Interval<T>& ray_t) const noexcept
+    -> const std::optional<HitRecord<T>> {
+  const auto c = closest(ray, ray_t);
+  if (!c)
+    return std::nullopt;
+  return record_for(ray, c.value());
+}
+
+template <class T>
+auto SphereGrid<T>::hit_distance(const Ray<T>& ray,
+                                 const Interval<T>& ray_t) const noexcept
+    -> std::optional<T> {
+  const auto c = closest(ray, ray_t);
+  return c ? std::optional(c->t) : std::nullopt;
+}
+
+// Amanatides & Woo traversal. A sphere spanning several cells may be tested
+// more than once; a hit only ends the walk once no nearer cell is left.
+template <class T>
+auto SphereGrid<T>::closest(const Ray<T>& ray,
+                            const Interval<T>& ray_t,
+                            const bool any_hit) const noexcept
+    -> std::optional<Closest> {
+  const auto& s = *m_storage;
+  if (s.spheres.empty())
+    return std::nullopt;
+  const auto inv_direction = inverse(ray.direction());
+  const auto entry = s.bounds.hit(ray, inv_direction, ray_t);
+  if (!entry)
+    return std::nullopt;
+
+  const auto p = ray.at(entry.value());
+  auto cell = std::array<std::size_t, 3>{};
+  auto step = std::array<int, 3>{};
+  auto next_t = std::array<T, 3>{};
+  auto delta_t = std::array<T, 3>{};
+  for (auto a = 0; a < 3; ++a) {
+    const auto i = static_cast<std::size_t>(a);
+    cell[i] = cell_of(s, axis(p, a), a);
+    const auto d = axis(ray.direction(), a);
+    const auto size = axis(s.cell_size, a);
+    const auto lo = axis(s.bounds.min(), a) + static_cast<T>(cell[i]) * size;
+    const auto inv = axis(inv_direction, a);
+    if (d > 0) {
+      step[i] = 1;
+      next_t[i] = (lo + size - axis(ray.origin(), a)) * inv;
+      delta_t[i] = size * inv;
+    } else if (d < 0) {
+      step[i] = -1;
+      next_t[i] = (lo - axis(ray.origin(), a)) * inv;
+      delta_t[i] = -size * inv;
+    } else {
+      next_t[i] = globals::infinity<T>;
+      delta_t[i] = globals::infinity<T>;
+    }
+  }
+
+  auto result = std::optional<Closest>{};
+  auto t_max = ray_t.max();
+  while (true) {
+    const auto c = flat_index(s, cell);
+    for (auto k = s.cell_start[c]; k < s.cell_start[c + 1]; ++k) {
+      const auto index = s.indices[k];
+      const auto& sphere = s.spheres[index];
+      const auto root =
+          sphere.hit_distance(ray, Interval<T>(ray_t.min(), t_max));
+      if (root) {
+        t_max = root.value();
+        result = Closest{.index = index, .t = t_max};
+        if (any_hit)
+          return result;
+      }
+    }
+
+    const auto a = static_cast<std::size_t>(std::ranges::min_element(next_t) -
+                                            next_t.begin());
+    if (next_t[a] >= t_max)
+      break;
+    if (step[a] > 0 ? cell[a] + 1 >= s.resolution[a] : cell[a] == 0)
+      break;
+    cell[a] = step[a] > 0 ? cell[a] + 1 : cell[a] - 1;
+    next_t[a] += delta_t[a];
+  }
+  return result;
+}
+
+template <class T>
+auto SphereGrid<T>::build(std::vector<Sphere<T>> spheres) noexcept
+    -> std::shared_ptr<const Storage> {
+  auto s = std::make_shared<Storage>(Storage{.spheres = std::move(spheres)});
+  if (s->spheres.empty())
+    return s;
+  const auto bounds = std::ranges::fold_left(
+      s->spheres, Aabb<T>{},
+      [](const auto& acc, const auto& p) {
+        return acc.merge(p.bounding_box());
+      });
+  s->bounds = bounds;
+  s->resolution = choose_resolution(bounds, s->spheres.size());
+  const auto extent = bounds.extent();
+  s->cell_size = Vec3<T>{extent.x() / static_cast<T>(s->resolution[0]),
+                         extent.y() / static_cast<T>(s->resolution[1]),
+                         extent.z() / static_cast<T>(s->resolution[2])};
+
+  // Counting sort: per-cell counts, prefix sums, then scatter the indices.
+  const auto cells = s->resolution[0] * s->resolution[1] * s->resolution[2];
+  s->cell_start.assign(cells + 1, 0);
+  auto for_each_cell = [&s](const Sphere<T>& sphere, auto&& fn) {
+    const auto [lo, hi] = cell_range(*s, sphere.bounding_box());
+    for (auto z = lo[2]; z <= hi[2]; ++z)
+      for (auto y = lo[1]; y <= hi[1]; ++y)
+        for (auto x = lo[0]; x <= hi[0]; ++x)
+          fn(flat_index(*s, {x, y, z}));
+  };
+  for (const auto& sphere : s->spheres)
+    for_each_cell(sphere, [&s](auto c) { ++s->cell_start[c + 1]; });
+  for (auto c = std::size_t{0}; c < cells; ++c)
+    s->cell_start[c + 1] += s->cell_start[c];
+
+  s->indices.resize(s->cell_start[cells]);
+  auto fill = std::vector<std::uint32_t>(s->cell_start.begin(),
+                                         s->cell_start.end() - 1);
+  for (auto i = std::size_t{0}; i < s->spheres.size(); ++i)
+    for_each_cell(s->spheres[i], [&s, &fill, i](auto c) {
+      s->indices[fill[c]++] = static_cast<std::uint32_t>(i);
+    });
+  return s;
+}
+
+// Cleary & Wyvill: cells proportional to the extent on each axis, about
+// `density` primitives per cell. Flat axes (a lattice on the ground) get a
+// single cell instead of collapsing the volume to zero.
+template <class T>
+auto SphereGrid<T>::choose_resolution(const Aabb<T>& bounds,
+                                      const std::size_t count) noexcept
+    -> std::array<std::size_t, 3> {
+  const auto extent = bounds.extent();
+  const auto longest = axis(extent, bounds.longest_axis());
+  if (longest <= 0)
+    return {1, 1, 1};
+  const auto flat = longest * T{1e-3};
+  const auto e = std::array<T, 3>{std::max(extent.x(), flat),
+                                  std::max(extent.y(), flat),
+                                  std::max(extent.z(), flat)};
+  const auto volume = e[0] * e[1] * e[2];
+  const auto cells_per_unit =
+      std::cbrt(density * static_cast<T>(count) / volume);
+  auto resolution = std::array<std::size_t, 3>{};
+  for (auto a = std::size_t{0}; a < 3; ++a)
+    resolution[a] = std::clamp<std::size_t>(
+        static_cast<std::size_t>(e[a] * cells_per_unit), 1, max_resolution);
+  return resolution;
+}
+
+template <class T>
+auto SphereGrid<T>::cell_range(const Storage& s, const Aabb<T>& box) noexcept
+    -> std::array<std::array<std::size_t, 3>, 2> {
+  auto range = std::array<std::array<std::size_t, 3>, 2>{};
+  for (auto a = 0; a < 3; ++a) {
+    const auto i = static_cast<std::size_t>(a);
+    range[0][i] = cell_of(s, axis(box.min(), a), a);
+    range[1][i] = cell_of(s, axis(box.max(), a), a);
+  }
+  return range;
+}
+
+template <class T>
+auto SphereGrid<T>::cell_of(const Storage& s,
+                            const T& x,
+                            const int a) noexcept -> std::size_t {
+  const auto size = axis(s.cell_size, a);
+  const auto last = s.resolution[static_cast<std::size_t>(a)] - 1;
+  if (size <= 0)
+    return 0;
+  const auto c = std::floor((x - axis(s.bounds.min(), a)) / size);
+  return std::clamp<std::size_t>(
+      c > 0 ? static_cast<std::size_t>(c) : 0, 0, last);
+}
+
+#endif  // !SPHERE_GRID_HPP
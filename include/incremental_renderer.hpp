@@ -0,0 +1,209 @@
+#ifndef INCREMENTAL_RENDERER_HPP
+#define INCREMENTAL_RENDERER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+#include "aabb.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "globals.hpp"
+#include "hittable_list.hpp"
+#include "thread_pool.hpp"
+#include "tile_dependencies.hpp"
+#include "tiles.hpp"
+#include "vec3.hpp"
+
+// A change the caller made to the world: object `object` of the
+// HittableList, or only its `primitive` if the object is a set. `bounds`
+// is where the changed geometry is now, for edits that move or add it.
+template <class T>
+struct SceneEdit {
+  std::uint32_t object{};
+  std::optional<std::uint32_t> primitive{};
+  std::optional<Aabb<T>> bounds{};
+};
+
+struct UpdateReport {
+  std::size_t tiles{};
+  // tiles that saw an edited primitive or whose pixels cover its bounds
+  std::size_t invalidated{};
+  // tiles re-rendered only to keep indirect lighting within the bound
+  std::size_t refreshed{};
+  double seconds{};
+};
+
+// Keeps a rendered image up to date under scene edits. Every tile records
+// what its camera rays and first bounces hit (dependencies::Recorder);
+// `update` re-renders just the tiles an edit can have changed there. The
+// edit can still show up elsewhere in deeper bounces, shadows and
+// reflections of moved geometry, so with a `max_staleness` of k every
+// update also re-renders the oldest tiles, 1/k of the image, and no tile
+// goes more than k updates without being rendered again. 0 never
+// refreshes.
+template <class T, class Image_t>
+class IncrementalRenderer {
+ public:
+  IncrementalRenderer() = delete;
+  IncrementalRenderer(ThreadPool& pool,
+                      const Camera<T, Image_t>& camera,
+                      const Image_t& tile_size,
+                      const std::size_t max_staleness)
+      : m_pool(pool),
+        m_camera(camera),
+        m_tile_size(tile_size),
+        m_max_staleness(max_staleness),
+        m_tiles(make_tiles(camera.width(), camera.height(), tile_size)),
+        m_dependencies(m_tiles.size()),
+        m_age(m_tiles.size()),
+        m_framebuffer(camera.width(), camera.height()) {};
+
+  // Renders every tile.
+  auto render(const HittableList<T>& world) -> UpdateReport;
+  // Re-renders after `edits` were applied to `world`.
+  auto update(const HittableList<T>& world,
+              std::span<const SceneEdit<T>> edits) -> UpdateReport;
+
+  [[nodiscard]] auto framebuffer() const noexcept
+      -> const Framebuffer<T, Image_t>& {
+    return m_framebuffer;
+  }
+
+ private:
+  auto render_tiles(const HittableList<T>& world,
+                    const std::vector<bool>& selected) -> void;
+  [[nodiscard]] auto affected(const SceneEdit<T>& edit) const
+      -> std::vector<bool>;
+
+  ThreadPool& m_pool;
+  const Camera<T, Image_t>& m_camera;
+  const Image_t m_tile_size{};
+  const std::size_t m_max_staleness{};
+  const std::vector<Tile<Image_t>> m_tiles{};
+  std::vector<dependencies::TileDependencies> m_dependencies{};
+  // updates since each tile was last rendered
+  std::vector<std::size_t> m_age{};
+  Framebuffer<T, Image_t> m_framebuffer;
+};
+
+template <class T, class Image_t>
+auto IncrementalRenderer<T, Image_t>::render(const HittableList<T>& world)
+    -> UpdateReport {
+  const auto start = std::chrono::steady_clock::now();
+  render_tiles(world, std::vector<bool>(m_tiles.size(), true));
+  return UpdateReport{
+      .tiles = m_tiles.size(),
+      .invalidated = m_tiles.size(),
+      .seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()};
+}
+
+template <class T, class Image_t>
+auto IncrementalRenderer<T, Image_t>::update(
+    const HittableList<T>& world,
+    std::span<const SceneEdit<T>> edits) -> UpdateReport {
+  const auto start = std::chrono::steady_clock::now();
+  auto selected = std::vector<bool>(m_tiles.size(), false);
+  for (const auto& edit : edits) {
+    const auto tiles = affected(edit);
+    for (auto i = std::size_t{0}; i < m_tiles.size(); ++i)
+      selected[i] = selected[i] || tiles[i];
+  }
+  const auto invalidated =
+      static_cast<std::size_t>(std::ranges::count(selected, true));
+
+  // The oldest of the rest, by age and then index so that ties are
+  // always broken the same way.
+  auto refreshed = std::size_t{0};
+  if (m_max_staleness > 0) {
+    auto rest = std::vector<std::size_t>{};
+    for (auto i = std::size_t{0}; i < m_tiles.size(); ++i)
+      if (!selected[i])
+        rest.push_back(i);
+    std::ranges::stable_sort(rest, [this](auto a, auto b) {
+      return m_age[a] > m_age[b];
+    });
+    const auto quota =
+        (m_tiles.size() + m_max_staleness - 1) / m_max_staleness;
+    refreshed = std::min(quota, rest.size());
+    for (auto k = std::size_t{0}; k < refreshed; ++k)
+      selected[rest[k]] = true;
+  }
+
+  render_tiles(world, selected);
+  return UpdateReport{
+      .tiles = m_tiles.size(),
+      .invalidated = invalidated,
+      .refreshed = refreshed,
+      .seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()};
+}
+
+template <class T, class Image_t>
+auto IncrementalRenderer<T, Image_t>::render_tiles(
+    const HittableList<T>& world,
+    const std::vector<bool>& selected) -> void {
+  for (auto i = std::size_t{0}; i < m_tiles.size(); ++i) {
+    if (!selected[i]) {
+      ++m_age[i];
+      continue;
+    }
+    m_age[i] = 0;
+    m_pool.submit([this, &world, i] {
+      const auto recorder = dependencies::Recorder(m_dependencies[i]);
+      m_camera.render_tile(world, m_tiles[i], m_framebuffer);
+    });
+  }
+  m_pool.wait();
+}
+
+// Tiles that hit the edited primitive, plus those the new bounds project
+// onto. The projection is padded by a tile for defocus blur; a box
+// reaching behind the camera takes every tile.
+template <class T, class Image_t>
+auto IncrementalRenderer<T, Image_t>::affected(const SceneEdit<T>& edit) const
+    -> std::vector<bool> {
+  const auto primitive =
+      edit.primitive.value_or(dependencies::TileDependencies::whole_object);
+  auto tiles = std::vector<bool>(m_tiles.size());
+  for (auto i = std::size_t{0}; i < m_tiles.size(); ++i)
+    tiles[i] = m_dependencies[i].may_depend_on(edit.object, primitive);
+  if (!edit.bounds)
+    return tiles;
+
+  const auto& box = edit.bounds.value();
+  auto x_min = globals::infinity<T>;
+  auto y_min = globals::infinity<T>;
+  auto x_max = -globals::infinity<T>;
+  auto y_max = -globals::infinity<T>;
+  for (auto corner = 0; corner < 8; ++corner) {
+    const auto p = Point3<T>{corner & 1 ? box.max().x() : box.min().x(),
+                             corner & 2 ? box.max().y() : box.min().y(),
+                             corner & 4 ? box.max().z() : box.min().z()};
+    const auto projected = m_camera.project(p);
+    if (!projected)
+      return std::vector<bool>(m_tiles.size(), true);
+    x_min = std::min(x_min, projected->first);
+    x_max = std::max(x_max, projected->first);
+    y_min = std::min(y_min, projected->second);
+    y_max = std::max(y_max, projected->second);
+  }
+  const auto pad = static_cast<T>(m_tile_size);
+  for (auto i = std::size_t{0}; i < m_tiles.size(); ++i) {
+    const auto& tile = m_tiles[i];
+    const auto overlaps = static_cast<T>(tile.x0) <= x_max + pad &&
+                          static_cast<T>(tile.x1) >= x_min - pad &&
+                          static_cast<T>(tile.y0) <= y_max + pad &&
+                          static_cast<T>(tile.y1) >= y_min - pad;
+    tiles[i] = tiles[i] || overlaps;
+  }
+  return tiles;
+}
+
+#endif  // !INCREMENTAL_RENDERER_HPP
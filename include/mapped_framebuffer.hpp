@@ -0,0 +1,215 @@
+#ifndef MAPPED_FRAMEBUFFER_HPP
+#define MAPPED_FRAMEBUFFER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "async_writer.hpp"
+#include "color.hpp"
+#include "tiles.hpp"
+
+// Float RGB framebuffer of any size, memory-mapped from an unlinked
+// scratch file. Pixels are stored tile by tile, each tile padded to
+// tile_size x tile_size, so a tile and a row of tiles are contiguous.
+// Tiles are written through `store` or edited in place through `tile`
+// and `release`. A released tile's pages leave the process at once and
+// go to the page cache, and from there to disk under memory pressure.
+// `write_ppm` streams the image out one row of tiles at a time. Resident
+// memory is therefore bounded by the tiles in flight plus one row of
+// tiles, whatever the resolution.
+template <class T, class Image_t>
+class MappedFramebuffer {
+ public:
+  using Texel = std::array<float, 3>;
+
+  MappedFramebuffer() = delete;
+  MappedFramebuffer(const MappedFramebuffer&) = delete;
+  auto operator=(const MappedFramebuffer&) -> MappedFramebuffer& = delete;
+  MappedFramebuffer(MappedFramebuffer&& other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_width(other.m_width),
+        m_height(other.m_height),
+        m_tile_size(other.m_tile_size) {};
+  ~MappedFramebuffer() {
+    if (m_data)
+      munmap(m_data, m_size);
+  }
+
+  // The scratch file is created in `directory` and unlinked right away; it
+  // is sparse, so untouched tiles take no disk space either.
+  [[nodiscard]] static auto create(const std::filesystem::path& directory,
+                                   const Image_t& width,
+                                   const Image_t& height,
+                                   const Image_t& tile_size)
+      -> std::optional<MappedFramebuffer>;
+
+  [[nodiscard]] auto width() const noexcept -> Image_t { return m_width; }
+  [[nodiscard]] auto height() const noexcept -> Image_t { return m_height; }
+  [[nodiscard]] auto tile_size() const noexcept -> Image_t {
+    return m_tile_size;
+  }
+
+  // The texels of the tile at `tile.x0, tile.y0`, row-major with a stride
+  // of tile_size; rows and columns past the image edge are padding.
+  [[nodiscard]] auto tile(const Tile<Image_t>& tile) noexcept
+      -> std::span<Texel>;
+  // Drops the tile's pages from this process; the data stays in the file.
+  auto release(const Tile<Image_t>& tile) noexcept -> void;
+  // Copies `pixels` (row-major, tile.area() of them) in and releases.
+  auto store(const Tile<Image_t>& tile,
+             std::span<const Color<T>> pixels) noexcept -> void;
+
+  auto write_ppm(std::ostream& out) -> void;
+
+ private:
+  MappedFramebuffer(void* data,
+                    const std::size_t size,
+                    const Image_t& width,
+                    const Image_t& height,
+                    const Image_t& tile_size)
+      : m_data(data),
+        m_size(size),
+        m_width(width),
+        m_height(height),
+        m_tile_size(tile_size) {};
+
+  [[nodiscard]] auto tiles_x() const noexcept -> std::size_t {
+    return static_cast<std::size_t>((m_width + m_tile_size - 1) / m_tile_size);
+  }
+  [[nodiscard]] auto tile_texels() const noexcept -> std::size_t {
+    return static_cast<std::size_t>(m_tile_size * m_tile_size);
+  }
+  [[nodiscard]] auto texels() const noexcept -> Texel* {
+    return static_cast<Texel*>(m_data);
+  }
+  // Offset in texels of the tile holding pixel (x0, y0).
+  [[nodiscard]] auto tile_offset(const Image_t& x0,
+                                 const Image_t& y0) const noexcept
+      -> std::size_t {
+    const auto tx = static_cast<std::size_t>(x0 / m_tile_size);
+    const auto ty = static_cast<std::size_t>(y0 / m_tile_size);
+    return (ty * tiles_x() + tx) * tile_texels();
+  }
+  // MADV_DONTNEED on a shared file mapping only unmaps: whole pages
+  // around the range may go, their contents come back from the file.
+  auto drop(const std::size_t first_texel,
+            const std::size_t texel_count) noexcept -> void;
+
+  void* m_data{};
+  std::size_t m_size{};
+  Image_t m_width{};
+  Image_t m_height{};
+  Image_t m_tile_size{};
+};
+
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::create(
+    const std::filesystem::path& directory,
+    const Image_t& width,
+    const Image_t& height,
+    const Image_t& tile_size) -> std::optional<MappedFramebuffer> {
+  if (width == 0 || height == 0 || tile_size == 0)
+    return std::nullopt;
+  const auto tiles = static_cast<std::size_t>(
+      ((width + tile_size - 1) / tile_size) *
+      ((height + tile_size - 1) / tile_size));
+  const auto size =
+      tiles * static_cast<std::size_t>(tile_size * tile_size) * sizeof(Texel);
+
+  auto name = (directory / "framebuffer.XXXXXX").string();
+  const auto fd = mkstemp(name.data());
+  if (fd < 0)
+    return std::nullopt;
+  unlink(name.c_str());
+  const auto mapped =
+      ftruncate(fd, static_cast<off_t>(size)) == 0
+          ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return std::nullopt;
+  return MappedFramebuffer(mapped, size, width, height, tile_size);
+}
+
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::tile(const Tile<Image_t>& tile) noexcept
+    -> std::span<Texel> {
+  return std::span(texels() + tile_offset(tile.x0, tile.y0), tile_texels());
+}
+
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::release(const Tile<Image_t>& tile) noexcept
+    -> void {
+  drop(tile_offset(tile.x0, tile.y0), tile_texels());
+}
+
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::store(
+    const Tile<Image_t>& tile,
+    std::span<const Color<T>> pixels) noexcept -> void {
+  const auto out = this->tile(tile);
+  const auto width = static_cast<std::size_t>(tile.x1 - tile.x0);
+  const auto stride = static_cast<std::size_t>(m_tile_size);
+  for (auto k = std::size_t{0}; k < pixels.size(); ++k) {
+    const auto& c = pixels[k];
+    out[(k / width) * stride + k % width] =
+        Texel{static_cast<float>(c.x()), static_cast<float>(c.y()),
+              static_cast<float>(c.z())};
+  }
+  release(tile);
+}
+
+// Row by row through one band of tiles at a time; the rows go to an
+// AsyncRowWriter, which encodes them while the next band is read.
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::write_ppm(std::ostream& out) -> void {
+  auto writer = AsyncRowWriter<T>(out, static_cast<std::size_t>(m_width),
+                                  static_cast<std::size_t>(m_height));
+  const auto stride = static_cast<std::size_t>(m_tile_size);
+  for (auto y0 = Image_t{0}; y0 < m_height; y0 += m_tile_size) {
+    const auto y1 = std::min(m_height, y0 + m_tile_size);
+    for (auto y = y0; y < y1; ++y) {
+      auto row = std::vector<Color<T>>{};
+      row.reserve(static_cast<std::size_t>(m_width));
+      for (auto x0 = Image_t{0}; x0 < m_width; x0 += m_tile_size) {
+        const auto* texel = texels() + tile_offset(x0, y0) +
+                            static_cast<std::size_t>(y - y0) * stride;
+        const auto x1 = std::min(m_width, x0 + m_tile_size);
+        for (auto x = x0; x < x1; ++x, ++texel)
+          row.emplace_back(static_cast<T>((*texel)[0]),
+                           static_cast<T>((*texel)[1]),
+                           static_cast<T>((*texel)[2]));
+      }
+      writer.push(std::move(row));
+    }
+    drop(tile_offset(0, y0), tiles_x() * tile_texels());
+  }
+  writer.finish();
+}
+
+template <class T, class Image_t>
+auto MappedFramebuffer<T, Image_t>::drop(
+    const std::size_t first_texel,
+    const std::size_t texel_count) noexcept -> void {
+  const auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+  const auto begin = reinterpret_cast<std::uintptr_t>(texels() + first_texel);
+  const auto end = begin + texel_count * sizeof(Texel);
+  const auto first = begin / page * page;
+  const auto last = (end + page - 1) / page * page;
+  madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+}
+
+#endif  // !MAPPED_FRAMEBUFFER_HPP
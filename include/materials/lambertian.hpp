@@ -2,10 +2,12 @@
 #define LAMBERTIAN_HPP
 
 #include <optional>
-#include <utility>
+#include <variant>
 #include "color.hpp"
+#include "globals.hpp"
 #include "materials/material_t.hpp"
 #include "ray.hpp"
+#include "textures/texture.hpp"
 
 template <class T>
 struct HitRecord;
@@ -13,8 +15,9 @@ struct HitRecord;
 template <class T>
 class Lambertian {
  public:
-  Lambertian(const Color<T>& albedo) : m_albedo(albedo) {};
+  Lambertian(const Albedo_t<T>& albedo) : m_albedo(albedo) {};
 
+  // normal + random unit vector is distributed as cos(theta) / pi
   [[nodiscard]] auto scatter([[maybe_unused]] const Ray<T>& ray_in,
                              const HitRecord<T>& hit_record) const noexcept
       -> std::optional<ScatterData_t<T>> {
@@ -22,12 +25,52 @@ class Lambertian {
     if (scatter_direction.near_zero())
       scatter_direction = hit_record.normal;
 
-    const auto ray = Ray<T>{hit_record.p, scatter_direction};
-    return std::optional(std::make_pair(ray, m_albedo));
+    const auto ray = hit_record.spawn_ray(scatter_direction, diffuse_spread);
+    const auto cos_theta = dot(unit_vector(scatter_direction), hit_record.normal);
+    if (cos_theta <= 0)
+      return std::nullopt;
+    return ScatterData_t<T>{.ray = ray,
+                            .bsdf = albedo(hit_record) / globals::pi<T>,
+                            .pdf = cos_theta / globals::pi<T>,
+                            .specular = false};
+  }
+
+  [[nodiscard]] auto eval([[maybe_unused]] const Ray<T>& ray_in,
+                          const HitRecord<T>& hit_record,
+                          const Vec3<T>& direction) const noexcept
+      -> BsdfEval_t<T> {
+    const auto cos_theta = dot(unit_vector(direction), hit_record.normal);
+    if (cos_theta <= 0)
+      return BsdfEval_t<T>{};
+    return BsdfEval_t<T>{.bsdf = albedo(hit_record) / globals::pi<T>,
+                         .pdf = cos_theta / globals::pi<T>};
+  }
+
+  // Over the whole surface (the coarsest mip of a texture), for proxies
+  // standing in for many primitives.
+  [[nodiscard]] auto mean_albedo() const noexcept -> Color<T> {
+    return albedo_at(m_albedo, T{0.5}, T{0.5}, T{1});
+  }
+  // The albedo if it is one color rather than a texture.
+  [[nodiscard]] auto constant_albedo() const noexcept
+      -> std::optional<Color<T>> {
+    if (const auto* color = std::get_if<Color<T>>(&m_albedo))
+      return *color;
+    return std::nullopt;
   }
 
  private:
-  Color<T> m_albedo{};
+  // Cone spread of diffuse bounces: indirect texture lookups blur anyway,
+  // and coarse mip levels keep them from thrashing the texture cache.
+  static constexpr T diffuse_spread = T{0.1};
+
+  [[nodiscard]] auto albedo(const HitRecord<T>& hit_record) const noexcept
+      -> Color<T> {
+    return albedo_at(m_albedo, hit_record.u, hit_record.v,
+                     hit_record.uv_footprint);
+  }
+
+  Albedo_t<T> m_albedo{};
 };
 
 #endif  // !LAMBERTIAN_HPP
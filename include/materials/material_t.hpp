@@ -1,11 +1,40 @@
 #ifndef HATERIAL_T_HPP
 #define HATERIAL_T_HPP
 
-#include <utility>
+#include <cmath>
 #include "color.hpp"
 #include "ray.hpp"
+#include "vec3.hpp"
 
+// Result of sampling a material lobe. For non-specular lobes `bsdf` is
+// f(wo, wi) and `pdf` the solid angle density of `ray.direction()`; delta
+// lobes (mirror, glass) set `specular` and carry the whole attenuation in
+// `bsdf` with pdf ignored.
 template <class T>
-using ScatterData_t = std::pair<Ray<T>, Color<T>>;
+struct ScatterData {
+  Ray<T> ray{};
+  Color<T> bsdf{};
+  T pdf{};
+  bool specular{};
+
+  [[nodiscard]] auto weight(const Vec3<T>& normal) const noexcept -> Color<T> {
+    if (specular)
+      return bsdf;
+    const auto cos_theta =
+        std::abs(dot(normal, unit_vector(ray.direction())));
+    return bsdf * (cos_theta / pdf);
+  }
+};
+
+template <class T>
+using ScatterData_t = ScatterData<T>;
+
+// f(wo, wi) and the pdf the material would sample wi with, used to weight
+// directions picked by another strategy (e.g. light sampling).
+template <class T>
+struct BsdfEval_t {
+  Color<T> bsdf{};
+  T pdf{};
+};
 
 #endif  // !HATERIAL_T_HPP
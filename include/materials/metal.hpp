@@ -1,38 +1,145 @@
 #ifndef METAL_HPP
 #define METAL_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <optional>
-#include <utility>
+#include <variant>
 #include "color.hpp"
+#include "globals.hpp"
 #include "materials/material_t.hpp"
+#include "onb.hpp"
 #include "ray.hpp"
+#include "textures/texture.hpp"
 #include "vec3.hpp"
 
 template <class T>
 struct HitRecord;
 
+// Fuzz is used as GGX roughness (alpha = fuzz^2); fuzz == 0 is a perfect
+// mirror.
 template <class T>
 class Metal {
  public:
-  Metal(const Color<T>& albedo, const T& fuzz = 0)
-      : m_albedo(albedo), m_fuzz(fuzz < 1. ? fuzz : 1) {};
+  Metal(const Albedo_t<T>& albedo, const T& fuzz = 0)
+      : m_albedo(albedo),
+        m_fuzz(fuzz < 1 ? fuzz : 1),
+        m_alpha(std::max<T>(m_fuzz * m_fuzz, T{1e-3})) {};
 
   [[nodiscard]] auto scatter(const Ray<T>& ray_in,
                              const HitRecord<T>& hit_record) const noexcept
       -> std::optional<ScatterData_t<T>> {
-    auto reflected = reflect(ray_in.direction(), hit_record.normal);
-    reflected =
-        unit_vector<T>(reflected) + (m_fuzz * Vec3<T>::random_unit_vector());
-    const auto scattered = Ray<T>(hit_record.p, reflected);
-    const auto attenuation = m_albedo;
-    return (dot(scattered.direction(), hit_record.normal) > 0.)
-               ? std::optional(std::make_pair(scattered, attenuation))
-               : std::nullopt;
+    if (m_fuzz <= 0) {
+      const auto reflected = reflect(ray_in.direction(), hit_record.normal);
+      return ScatterData_t<T>{.ray = hit_record.spawn_ray(reflected),
+                              .bsdf = albedo(hit_record),
+                              .pdf = 0,
+                              .specular = true};
+    }
+
+    const auto onb = Onb<T>(hit_record.normal);
+    const auto wo = onb.to_local(-unit_vector(ray_in.direction()));
+    if (wo.z() <= 0)
+      return std::nullopt;
+
+    const auto h = sample_half_vector();
+    const auto wi = 2 * dot(wo, h) * h - wo;
+    if (wi.z() <= 0)
+      return std::nullopt;
+
+    const auto [bsdf, pdf] = eval_local(wo, wi, albedo(hit_record));
+    if (pdf <= 0)
+      return std::nullopt;
+    return ScatterData_t<T>{.ray = hit_record.spawn_ray(onb.to_world(wi)),
+                            .bsdf = bsdf,
+                            .pdf = pdf,
+                            .specular = false};
+  }
+
+  [[nodiscard]] auto eval(const Ray<T>& ray_in,
+                          const HitRecord<T>& hit_record,
+                          const Vec3<T>& direction) const noexcept
+      -> BsdfEval_t<T> {
+    if (m_fuzz <= 0)
+      return BsdfEval_t<T>{};
+    const auto onb = Onb<T>(hit_record.normal);
+    return eval_local(onb.to_local(-unit_vector(ray_in.direction())),
+                      onb.to_local(unit_vector(direction)),
+                      albedo(hit_record));
   }
 
+  // See Lambertian::mean_albedo.
+  [[nodiscard]] auto mean_albedo() const noexcept -> Color<T> {
+    return albedo_at(m_albedo, T{0.5}, T{0.5}, T{1});
+  }
+  // See Lambertian::constant_albedo.
+  [[nodiscard]] auto constant_albedo() const noexcept
+      -> std::optional<Color<T>> {
+    if (const auto* color = std::get_if<Color<T>>(&m_albedo))
+      return *color;
+    return std::nullopt;
+  }
+  [[nodiscard]] auto fuzz() const noexcept -> T { return m_fuzz; }
+
  private:
-  Color<T> m_albedo{};
+  [[nodiscard]] auto sample_half_vector() const noexcept -> Vec3<T>;
+  [[nodiscard]] auto eval_local(const Vec3<T>& wo,
+                                const Vec3<T>& wi,
+                                const Color<T>& albedo) const noexcept
+      -> BsdfEval_t<T>;
+  [[nodiscard]] auto albedo(const HitRecord<T>& hit_record) const noexcept
+      -> Color<T> {
+    return albedo_at(m_albedo, hit_record.u, hit_record.v,
+                     hit_record.uv_footprint);
+  }
+  [[nodiscard]] auto distribution(const T& cos_h) const noexcept -> T;
+  [[nodiscard]] auto smith_g1(const T& cos_v) const noexcept -> T;
+
+  Albedo_t<T> m_albedo{};
   T m_fuzz{};
+  T m_alpha{};
 };
 
+template <class T>
+auto Metal<T>::sample_half_vector() const noexcept -> Vec3<T> {
+  const auto u1 = globals::random_t<T>();
+  const auto u2 = globals::random_t<T>();
+  const auto tan2 = m_alpha * m_alpha * u1 / (T{1} - u1);
+  const auto cos_h = T{1} / std::sqrt(T{1} + tan2);
+  const auto sin_h = std::sqrt(std::max<T>(T{0}, T{1} - cos_h * cos_h));
+  const auto phi = 2 * globals::pi<T> * u2;
+  return Vec3<T>{sin_h * std::cos(phi), sin_h * std::sin(phi), cos_h};
+}
+
+template <class T>
+auto Metal<T>::eval_local(const Vec3<T>& wo,
+                          const Vec3<T>& wi,
+                          const Color<T>& albedo) const noexcept
+    -> BsdfEval_t<T> {
+  if (wo.z() <= 0 || wi.z() <= 0)
+    return BsdfEval_t<T>{};
+  const auto h = unit_vector(wo + wi);
+  const auto o_dot_h = dot(wo, h);
+  const auto d = distribution(h.z());
+  const auto g = smith_g1(wo.z()) * smith_g1(wi.z());
+  const auto schlick = std::pow(T{1} - std::clamp<T>(o_dot_h, 0, 1), T{5});
+  const auto fresnel = albedo + (Color<T>{1, 1, 1} - albedo) * schlick;
+  return BsdfEval_t<T>{.bsdf = fresnel * (d * g / (4 * wo.z() * wi.z())),
+                       .pdf = d * h.z() / (4 * o_dot_h)};
+}
+
+template <class T>
+auto Metal<T>::distribution(const T& cos_h) const noexcept -> T {
+  const auto a2 = m_alpha * m_alpha;
+  const auto denom = (a2 - 1) * cos_h * cos_h + 1;
+  return a2 / (globals::pi<T> * denom * denom);
+}
+
+template <class T>
+auto Metal<T>::smith_g1(const T& cos_v) const noexcept -> T {
+  const auto cos2 = cos_v * cos_v;
+  const auto tan2 = (T{1} - cos2) / cos2;
+  return 2 / (T{1} + std::sqrt(T{1} + m_alpha * m_alpha * tan2));
+}
+
 #endif  // !METAL_HPP
@@ -0,0 +1,106 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <sched.h>
+
+// NUMA topology from sysfs and thread pinning through sched_setaffinity,
+// so no libnuma is needed. Where /sys/devices/system/node is missing
+// (non-NUMA kernels, some containers) everything falls back to a single
+// node holding every CPU the process may run on.
+namespace numa {
+
+struct Node {
+  int id{};
+  std::vector<int> cpus{};
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+[[nodiscard]] inline auto parse_cpu_list(std::string_view list)
+    -> std::vector<int> {
+  auto cpus = std::vector<int>{};
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    const auto range = list.substr(0, comma);
+    auto first = -1;
+    auto last = -1;
+    const auto [end, ec] =
+        std::from_chars(range.data(), range.data() + range.size(), first);
+    if (ec == std::errc{}) {
+      last = first;
+      if (end != range.data() + range.size() && *end == '-')
+        std::from_chars(end + 1, range.data() + range.size(), last);
+      for (auto cpu = first; cpu <= last; ++cpu)
+        cpus.push_back(cpu);
+    }
+    list = comma == std::string_view::npos ? std::string_view{}
+                                           : list.substr(comma + 1);
+  }
+  return cpus;
+}
+
+[[nodiscard]] inline auto allowed_cpus() -> std::vector<int> {
+  auto set = cpu_set_t{};
+  CPU_ZERO(&set);
+  auto cpus = std::vector<int>{};
+  if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    return cpus;
+  for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    if (CPU_ISSET(static_cast<std::size_t>(cpu), &set))
+      cpus.push_back(cpu);
+  return cpus;
+}
+
+// Nodes with at least one CPU this process may use, by id.
+[[nodiscard]] inline auto topology() -> std::vector<Node> {
+  namespace fs = std::filesystem;
+  const auto allowed = allowed_cpus();
+  auto nodes = std::vector<Node>{};
+  auto error = std::error_code{};
+  for (const auto& entry :
+       fs::directory_iterator("/sys/devices/system/node", error)) {
+    const auto name = entry.path().filename().string();
+    auto id = -1;
+    if (!name.starts_with("node") ||
+        std::from_chars(name.data() + 4, name.data() + name.size(), id).ec !=
+            std::errc{})
+      continue;
+    auto file = std::ifstream(entry.path() / "cpulist");
+    auto list = std::string{};
+    std::getline(file, list);
+    auto cpus = parse_cpu_list(list);
+    std::erase_if(cpus, [&allowed](auto cpu) {
+      return !std::ranges::binary_search(allowed, cpu);
+    });
+    if (!cpus.empty())
+      nodes.push_back(Node{.id = id, .cpus = std::move(cpus)});
+  }
+  if (nodes.empty())
+    nodes.push_back(Node{.id = 0, .cpus = allowed});
+  std::ranges::sort(nodes, {}, &Node::id);
+  return nodes;
+}
+
+// Restricts the calling thread to `cpus`; false (and unpinned) if the
+// kernel refuses.
+inline auto pin_current_thread(const std::vector<int>& cpus) noexcept
+    -> bool {
+  auto set = cpu_set_t{};
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus)
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(static_cast<std::size_t>(cpu), &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+}  // namespace numa
+
+#endif  // !NUMA_HPP
@@ -0,0 +1,200 @@
+#ifndef NUMA_RENDERER_HPP
+#define NUMA_RENDERER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "hittable_list.hpp"
+#include "numa.hpp"
+#include "render_stats.hpp"
+#include "tiles.hpp"
+
+// Renders one image with workers pinned per NUMA node. Each node owns a
+// contiguous band of tiles and only steals from other bands once its own
+// is done; tile pixels are allocated by the worker that traces them, so
+// first touch puts them on that worker's node. With `replicate`, every
+// node also traces its own copy of the scene instead of the shared one.
+template <class T, class Image_t>
+class NumaRenderer {
+ public:
+  struct NodeReport {
+    int node{};
+    std::size_t threads{};
+    std::size_t tiles{};
+    std::size_t stolen{};
+    std::size_t pixels{};
+    std::size_t rays{};
+    double busy_seconds{};  // summed over the node's threads
+    // from the node's first tile claim to its last tile done, what its
+    // throughput is measured over
+    double wall_seconds{};
+    bool pinned{true};
+    bool replicated{};
+  };
+
+  NumaRenderer() = delete;
+  NumaRenderer(std::vector<numa::Node> nodes,
+               const std::size_t threads,
+               const bool replicate)
+      : m_nodes(std::move(nodes)),
+        m_threads(split_threads(m_nodes, threads)),
+        m_replicate(replicate) {};
+
+  [[nodiscard]] auto render(const HittableList<T>& world,
+                            const Camera<T, Image_t>& camera,
+                            const Image_t& tile_size)
+      -> Framebuffer<T, Image_t>;
+
+  // Filled by the last render.
+  [[nodiscard]] auto reports() const noexcept
+      -> const std::vector<NodeReport>& {
+    return m_reports;
+  }
+
+ private:
+  // Proportional to each node's CPUs, at least one per node.
+  [[nodiscard]] static auto split_threads(const std::vector<numa::Node>& nodes,
+                                          const std::size_t threads)
+      -> std::vector<std::size_t>;
+
+  const std::vector<numa::Node> m_nodes;
+  const std::vector<std::size_t> m_threads;
+  const bool m_replicate{};
+  std::vector<NodeReport> m_reports{};
+};
+
+template <class T, class Image_t>
+auto NumaRenderer<T, Image_t>::split_threads(
+    const std::vector<numa::Node>& nodes,
+    const std::size_t threads) -> std::vector<std::size_t> {
+  auto cpus = std::size_t{0};
+  for (const auto& node : nodes)
+    cpus += node.cpus.size();
+  auto split = std::vector<std::size_t>{};
+  for (const auto& node : nodes)
+    split.push_back(std::max<std::size_t>(
+        1, threads * node.cpus.size() / std::max<std::size_t>(cpus, 1)));
+  return split;
+}
+
+template <class T, class Image_t>
+auto NumaRenderer<T, Image_t>::render(const HittableList<T>& world,
+                                      const Camera<T, Image_t>& camera,
+                                      const Image_t& tile_size)
+    -> Framebuffer<T, Image_t> {
+  const auto node_count = m_nodes.size();
+  m_reports.assign(node_count, NodeReport{});
+  for (auto k = std::size_t{0}; k < node_count; ++k) {
+    m_reports[k].node = m_nodes[k].id;
+    m_reports[k].threads = m_threads[k];
+    m_reports[k].replicated = m_replicate;
+  }
+
+  // Replicas are built by a thread already pinned to their node.
+  auto replicas = std::vector<std::optional<HittableList<T>>>(node_count);
+  if (m_replicate) {
+    auto builders = std::vector<std::jthread>{};
+    for (auto k = std::size_t{0}; k < node_count; ++k)
+      builders.emplace_back([&, k] {
+        m_reports[k].pinned = numa::pin_current_thread(m_nodes[k].cpus);
+        replicas[k] = world.replicate();
+      });
+  }
+  auto scene = [&](const std::size_t k) -> const HittableList<T>& {
+    return replicas[k] ? replicas[k].value() : world;
+  };
+
+  const auto tiles = make_tiles(camera.width(), camera.height(), tile_size);
+  auto pixels = std::vector<std::vector<Color<T>>>(tiles.size());
+  // Node k's band is tiles [band_start(k), band_start(k + 1)).
+  auto band_start = [&](const std::size_t k) {
+    return tiles.size() * k / node_count;
+  };
+  auto next = std::vector<std::atomic<std::size_t>>(node_count);
+  for (auto k = std::size_t{0}; k < node_count; ++k)
+    next[k] = band_start(k);
+  auto claim = [&](const std::size_t k) -> std::optional<std::size_t> {
+    const auto i = next[k].fetch_add(1, std::memory_order_relaxed);
+    return i < band_start(k + 1) ? std::optional(i) : std::nullopt;
+  };
+
+  using Clock = std::chrono::steady_clock;
+  // Per node, the earliest first claim and the latest finish of its
+  // threads; guarded by report_mutex.
+  auto first_claim = std::vector<std::optional<Clock::time_point>>(node_count);
+  auto last_done = std::vector<Clock::time_point>(node_count);
+  auto report_mutex = std::mutex{};
+  auto work = [&](const std::size_t k) {
+    if (!numa::pin_current_thread(m_nodes[k].cpus)) {
+      const auto lock = std::scoped_lock(report_mutex);
+      m_reports[k].pinned = false;
+    }
+    const auto rays_before = render_stats::counters.rays;
+    const auto start = Clock::now();
+    auto first = std::optional<Clock::time_point>{};
+    auto done = NodeReport{};
+    // own band first, then the others in order
+    for (auto step = std::size_t{0}; step < node_count; ++step) {
+      const auto band = (k + step) % node_count;
+      while (const auto i = claim(band)) {
+        if (!first)
+          first = Clock::now();
+        const auto& tile = tiles[i.value()];
+        auto& out = pixels[i.value()];
+        out.resize(static_cast<std::size_t>(tile.area()));
+        const auto width = tile.x1 - tile.x0;
+        camera.trace_tile(scene(k), tile, [&](auto x, auto y, const auto& c) {
+          out[static_cast<std::size_t>((y - tile.y0) * width + x - tile.x0)] =
+              c;
+        });
+        ++done.tiles;
+        done.stolen += step > 0 ? 1 : 0;
+        done.pixels += static_cast<std::size_t>(tile.area());
+      }
+    }
+    const auto end = Clock::now();
+    const auto busy = std::chrono::duration<double>(end - start).count();
+    const auto lock = std::scoped_lock(report_mutex);
+    if (first) {
+      first_claim[k] = std::min(first_claim[k].value_or(first.value()),
+                                first.value());
+      last_done[k] = std::max(last_done[k], end);
+    }
+    auto& r = m_reports[k];
+    r.tiles += done.tiles;
+    r.stolen += done.stolen;
+    r.pixels += done.pixels;
+    r.rays += render_stats::counters.rays - rays_before;
+    r.busy_seconds += busy;
+  };
+  {
+    auto workers = std::vector<std::jthread>{};
+    for (auto k = std::size_t{0}; k < node_count; ++k)
+      for (auto t = std::size_t{0}; t < m_threads[k]; ++t)
+        workers.emplace_back(work, k);
+  }
+  for (auto k = std::size_t{0}; k < node_count; ++k)
+    if (first_claim[k])
+      m_reports[k].wall_seconds =
+          std::chrono::duration<double>(last_done[k] - first_claim[k].value())
+              .count();
+
+  auto framebuffer = Framebuffer<T, Image_t>(camera.width(), camera.height());
+  for (auto i = std::size_t{0}; i < tiles.size(); ++i) {
+    const auto& tile = tiles[i];
+    auto pixel = pixels[i].begin();
+    std::ranges::for_each(tile.pixels(), [&](auto&& p) {
+      framebuffer.at(p.first, p.second) = *pixel++;
+    });
+  }
+  return framebuffer;
+}
+
+#endif  // !NUMA_RENDERER_HPP
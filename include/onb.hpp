@@ -0,0 +1,37 @@
+#ifndef ONB_HPP
+#define ONB_HPP
+
+#include <cmath>
+#include "vec3.hpp"
+
+// Orthonormal basis around a unit normal (Duff et al. 2017, branchless).
+template <class T>
+class Onb {
+ public:
+  Onb() = delete;
+  Onb(const Vec3<T>& n) : m_w(n) {
+    const T sign = std::copysign(T{1}, n.z());
+    const T a = T{-1} / (sign + n.z());
+    const T b = n.x() * n.y() * a;
+    m_u = Vec3<T>{T{1} + sign * n.x() * n.x() * a, sign * b, -sign * n.x()};
+    m_v = Vec3<T>{b, sign + n.y() * n.y() * a, -n.y()};
+  };
+
+  [[nodiscard]] auto u() const noexcept -> const Vec3<T>& { return m_u; }
+  [[nodiscard]] auto v() const noexcept -> const Vec3<T>& { return m_v; }
+  [[nodiscard]] auto w() const noexcept -> const Vec3<T>& { return m_w; }
+
+  [[nodiscard]] auto to_world(const Vec3<T>& a) const noexcept -> Vec3<T> {
+    return a.x() * m_u + a.y() * m_v + a.z() * m_w;
+  }
+  [[nodiscard]] auto to_local(const Vec3<T>& a) const noexcept -> Vec3<T> {
+    return Vec3<T>{dot(a, m_u), dot(a, m_v), dot(a, m_w)};
+  }
+
+ private:
+  Vec3<T> m_u{};
+  Vec3<T> m_v{};
+  Vec3<T> m_w{};
+};
+
+#endif  // !ONB_HPP
@@ -0,0 +1,278 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include "thread_pool.hpp"
+
+struct Options {
+  bool single_precision{};
+  bool compact{};
+  std::optional<double> lod{};
+  bool grid{};
+  bool instanced{};
+  std::optional<std::string> generate{};
+  std::optional<std::string> sequence{};
+  std::size_t frames{24};
+  std::optional<std::string> batch{};
+  std::optional<std::size_t> turntable{};
+  std::string output_dir{"."};
+  std::size_t threads{ThreadPool::default_threads()};
+  std::optional<std::string> heatmap{};
+  std::optional<std::string> trace{};
+  std::optional<std::size_t> incremental{};
+  std::size_t max_staleness{8};
+  bool perf{};
+  std::optional<std::string> texture{};
+  std::size_t texture_budget_mib{64};
+  std::optional<std::string> environment{};
+  std::optional<double> radiance_cache{};
+  std::optional<double> ambient_occlusion{};
+  std::optional<std::string> serve{};
+  std::size_t scene_cache{4};
+  bool numa{};
+  bool numa_replicate{};
+  std::optional<std::size_t> width{};
+  std::optional<std::size_t> samples{};
+  std::optional<std::string> out_of_core{};
+  std::optional<std::string> shared_framebuffer{};
+};
+
+inline auto print_usage(std::ostream& out) -> void {
+  out << "usage: RayTracingFunctionalCpp [options] > image.ppm\n"
+      << "  --float             trace in single precision\n"
+      << "  --compact           store the sphere lattice as float32 spheres\n"
+      << "                      with a 16-bit material index and a\n"
+      << "                      quantized BVH\n"
+      << "  --lod <error>       as --compact, tracing clusters narrower than\n"
+      << "                      <error> ray footprints as one proxy sphere\n"
+      << "  --grid              put the sphere lattice in a uniform grid\n"
+      << "  --instanced         build the lattice from transformed copies of\n"
+      << "                      one shared sphere cluster\n"
+      << "  --generate <spec>   replace the lattice with generated spheres,\n"
+      << "                      e.g. count=1000000,distribution=clustered\n"
+      << "                      (see include/scene_generator.hpp)\n"
+      << "  --sequence <file>   render a camera path, one key per line:\n"
+      << "                      time lookfrom.xyz lookat.xyz v_fov\n"
+      << "  --frames <n>        frames in the sequence (default 24)\n"
+      << "  --batch <file>      render several views of the scene, one per\n"
+      << "                      line: lookfrom.xyz lookat.xyz v_fov\n"
+      << "  --turntable <n>     render n views orbiting the default camera\n"
+      << "  --output-dir <dir>  where sequence frames and views are written\n"
+      << "  --threads <n>       worker threads (default: all cores)\n"
+      << "  --width <n>         image width (default 200)\n"
+      << "  --samples <n>       samples per pixel (default 100)\n"
+      << "  --out-of-core <dir> render in tiles into a float framebuffer\n"
+      << "                      mapped from a scratch file in <dir>\n"
+      << "  --shm <name>        render in passes into the POSIX shared memory\n"
+      << "                      segment <name> for live viewers\n"
+      << "  --texture <file>    binary PPM (P6) mapped onto the matte sphere\n"
+      << "  --texture-budget <MiB>\n"
+      << "                      texture cache size (default 64)\n"
+      << "  --environment <file>\n"
+      << "                      lat-long HDR sky as a portable float map\n"
+      << "                      (PFM), importance sampled as a light\n"
+      << "  --radiance-cache <cell size>\n"
+      << "                      reuse diffuse radiance from a hash grid of\n"
+      << "                      cells this wide (biased, for previews)\n"
+      << "  --ao <radius>       render ambient occlusion within <radius>\n"
+      << "                      instead of path tracing (layout previews)\n"
+      << "  --serve <socket>    run as a render service on a Unix domain\n"
+      << "                      socket (see include/render_server.hpp)\n"
+      << "  --scene-cache <n>   scenes the service keeps built (default 4)\n"
+      << "  --numa              pin workers per NUMA node, each rendering\n"
+      << "                      its own band of tiles first\n"
+      << "  --numa-replicate    as --numa, with a copy of the scene per node\n"
+      << "  --heatmap <file>    render in tiles and write the per-tile cost\n"
+      << "                      as a false color PPM\n"
+      << "  --trace <file>      render in tiles and write a Chrome\n"
+      << "                      trace_event timeline of the tiles\n"
+      << "  --incremental <n>   render, then re-render only what each of n\n"
+      << "                      random sphere edits changed\n"
+      << "  --max-staleness <k> re-render every tile at least every k edits\n"
+      << "                      (default 8, 0 for never)\n"
+      << "  --perf              render in tiles and report hardware counters\n"
+      << "                      per ray for each render phase\n";
+}
+
+[[nodiscard]] inline auto parse_count(std::string_view arg)
+    -> std::optional<std::size_t> {
+  auto value = std::size_t{};
+  const auto [end, ec] =
+      std::from_chars(arg.data(), arg.data() + arg.size(), value);
+  if (ec != std::errc{} || end != arg.data() + arg.size() || value == 0)
+    return std::nullopt;
+  return value;
+}
+
+[[nodiscard]] inline auto parse_length(std::string_view arg)
+    -> std::optional<double> {
+  auto value = 0.;
+  const auto [end, ec] =
+      std::from_chars(arg.data(), arg.data() + arg.size(), value);
+  if (ec != std::errc{} || end != arg.data() + arg.size() || !(value > 0))
+    return std::nullopt;
+  return value;
+}
+
+[[nodiscard]] inline auto parse_options(int argc, char* argv[])
+    -> std::optional<Options> {
+  auto options = Options{};
+  const auto args = std::span(argv, static_cast<std::size_t>(argc));
+  for (auto i = std::size_t{1}; i < args.size(); ++i) {
+    const auto arg = std::string_view(args[i]);
+    const auto value = [&]() -> std::optional<std::string_view> {
+      if (i + 1 >= args.size())
+        return std::nullopt;
+      return std::string_view(args[++i]);
+    };
+    auto count = [&value](std::size_t& out) {
+      const auto v = value();
+      const auto n = v ? parse_count(v.value()) : std::nullopt;
+      if (n)
+        out = n.value();
+      return n.has_value();
+    };
+
+    if (arg == "--float") {
+      options.single_precision = true;
+    } else if (arg == "--compact") {
+      options.compact = true;
+    } else if (arg == "--lod") {
+      const auto v = value();
+      options.lod = v ? parse_length(v.value()) : std::nullopt;
+      if (!options.lod)
+        return std::nullopt;
+      options.compact = true;
+    } else if (arg == "--grid") {
+      options.grid = true;
+    } else if (arg == "--instanced") {
+      options.instanced = true;
+    } else if (arg == "--generate") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.generate = std::string(v.value());
+    } else if (arg == "--sequence") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.sequence = std::string(v.value());
+    } else if (arg == "--frames") {
+      if (!count(options.frames))
+        return std::nullopt;
+    } else if (arg == "--batch") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.batch = std::string(v.value());
+    } else if (arg == "--turntable") {
+      auto n = std::size_t{};
+      if (!count(n))
+        return std::nullopt;
+      options.turntable = n;
+    } else if (arg == "--output-dir") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.output_dir = std::string(v.value());
+    } else if (arg == "--threads") {
+      if (!count(options.threads))
+        return std::nullopt;
+    } else if (arg == "--width") {
+      auto n = std::size_t{};
+      if (!count(n))
+        return std::nullopt;
+      options.width = n;
+    } else if (arg == "--samples") {
+      auto n = std::size_t{};
+      if (!count(n))
+        return std::nullopt;
+      options.samples = n;
+    } else if (arg == "--out-of-core") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.out_of_core = std::string(v.value());
+    } else if (arg == "--shm") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.shared_framebuffer = std::string(v.value());
+    } else if (arg == "--texture") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.texture = std::string(v.value());
+    } else if (arg == "--texture-budget") {
+      if (!count(options.texture_budget_mib))
+        return std::nullopt;
+    } else if (arg == "--environment") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.environment = std::string(v.value());
+    } else if (arg == "--radiance-cache") {
+      const auto v = value();
+      options.radiance_cache = v ? parse_length(v.value()) : std::nullopt;
+      if (!options.radiance_cache)
+        return std::nullopt;
+    } else if (arg == "--ao") {
+      const auto v = value();
+      options.ambient_occlusion = v ? parse_length(v.value()) : std::nullopt;
+      if (!options.ambient_occlusion)
+        return std::nullopt;
+    } else if (arg == "--serve") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.serve = std::string(v.value());
+    } else if (arg == "--scene-cache") {
+      if (!count(options.scene_cache))
+        return std::nullopt;
+    } else if (arg == "--numa") {
+      options.numa = true;
+    } else if (arg == "--numa-replicate") {
+      options.numa = true;
+      options.numa_replicate = true;
+    } else if (arg == "--incremental") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.incremental = parse_count(v.value());
+      if (!options.incremental)
+        return std::nullopt;
+    } else if (arg == "--max-staleness") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      const auto n = v.value() == "0" ? std::optional<std::size_t>(0)
+                                      : parse_count(v.value());
+      if (!n)
+        return std::nullopt;
+      options.max_staleness = n.value();
+    } else if (arg == "--perf") {
+      options.perf = true;
+    } else if (arg == "--heatmap") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.heatmap = std::string(v.value());
+    } else if (arg == "--trace") {
+      const auto v = value();
+      if (!v)
+        return std::nullopt;
+      options.trace = std::string(v.value());
+    } else {
+      return std::nullopt;
+    }
+  }
+  return options;
+}
+
+#endif  // !OPTIONS_HPP
@@ -0,0 +1,295 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "render_stats.hpp"
+
+// Hardware counters per render thread, split by render phase. Counting is
+// limited to user space, so the read() at each phase boundary does not
+// count itself. Where the kernel refuses a counter (perf_event_paranoid,
+// containers, VMs without a PMU) that column reads n/a; phase times and
+// call counts are always there.
+namespace perf {
+
+enum class Event {
+  cycles,
+  instructions,
+  l1d_misses,
+  llc_misses,
+  branch_misses
+};
+inline constexpr std::size_t event_count = 5;
+
+enum class Phase { camera, intersection, scatter, output };
+inline constexpr std::size_t phase_count = 4;
+inline constexpr std::array<std::string_view, phase_count> phase_names{
+    "camera rays", "intersection", "scatter", "output"};
+
+struct Reading {
+  std::array<std::uint64_t, event_count> events{};
+  std::uint64_t ns{};
+
+  auto operator+=(const Reading& other) noexcept -> Reading& {
+    for (auto e = std::size_t{0}; e < event_count; ++e)
+      events[e] += other.events[e];
+    ns += other.ns;
+    return *this;
+  }
+  [[nodiscard]] auto operator-(const Reading& other) const noexcept
+      -> Reading {
+    auto d = *this;
+    for (auto e = std::size_t{0}; e < event_count; ++e)
+      d.events[e] -= other.events[e];
+    d.ns -= other.ns;
+    return d;
+  }
+};
+
+// The five events of the calling thread as one group, read together.
+// Events the kernel refuses are left out of the group and read as 0.
+class CounterGroup {
+ public:
+  CounterGroup();
+  CounterGroup(const CounterGroup&) = delete;
+  auto operator=(const CounterGroup&) -> CounterGroup& = delete;
+  ~CounterGroup() {
+    for (const auto fd : m_fds)
+      if (fd >= 0)
+        close(fd);
+  }
+
+  [[nodiscard]] auto available(const Event event) const noexcept -> bool {
+    return m_fds[static_cast<std::size_t>(event)] >= 0;
+  }
+  // Why the first refused event was refused; empty if none was.
+  [[nodiscard]] auto error() const noexcept -> const std::string& {
+    return m_error;
+  }
+  [[nodiscard]] auto read() const noexcept -> Reading;
+
+ private:
+  std::array<int, event_count> m_fds{-1, -1, -1, -1, -1};
+  // position of each open event in the group's read buffer
+  std::array<std::size_t, event_count> m_slots{};
+  int m_leader{-1};
+  std::size_t m_open{};
+  std::string m_error{};
+};
+
+struct ThreadProfile {
+  CounterGroup counters{};
+  std::array<Reading, phase_count> phases{};
+  std::array<std::uint64_t, phase_count> calls{};
+  // everything between attach and detach, phases included
+  Reading total{};
+  std::uint64_t rays{};
+};
+
+// The calling thread's profile while attached to a Session, else null.
+inline thread_local ThreadProfile* active = nullptr;
+
+// Adds the counters between construction and destruction to `phase`.
+// Phases must not nest. Costs one thread_local load when not profiling.
+class PhaseScope {
+ public:
+  explicit PhaseScope(const Phase phase) noexcept
+      : m_profile(active), m_phase(static_cast<std::size_t>(phase)) {
+    if (m_profile)
+      m_start = m_profile->counters.read();
+  }
+  PhaseScope(const PhaseScope&) = delete;
+  auto operator=(const PhaseScope&) -> PhaseScope& = delete;
+  ~PhaseScope() {
+    if (!m_profile)
+      return;
+    m_profile->phases[m_phase] += m_profile->counters.read() - m_start;
+    ++m_profile->calls[m_phase];
+  }
+
+ private:
+  ThreadProfile* m_profile{};
+  std::size_t m_phase{};
+  Reading m_start{};
+};
+
+// Owns a profile per thread that ever attached. Pool workers attach for
+// the duration of each job, so their thread_local pointer never outlives
+// the session.
+class Session {
+ public:
+  class Attach {
+   public:
+    explicit Attach(Session& session)
+        : m_profile(session.profile()),
+          m_rays(render_stats::counters.rays),
+          m_start(m_profile->counters.read()) {
+      active = m_profile;
+    };
+    Attach(const Attach&) = delete;
+    auto operator=(const Attach&) -> Attach& = delete;
+    ~Attach() {
+      active = nullptr;
+      m_profile->total += m_profile->counters.read() - m_start;
+      m_profile->rays += render_stats::counters.rays - m_rays;
+    }
+
+   private:
+    ThreadProfile* m_profile{};
+    std::uint64_t m_rays{};
+    Reading m_start{};
+  };
+
+  // Per phase and per ray, with the unattributed rest as "other".
+  auto write_report(std::ostream& out) const -> void;
+
+ private:
+  auto profile() -> ThreadProfile*;
+
+  mutable std::mutex m_mutex{};
+  std::map<std::thread::id, std::unique_ptr<ThreadProfile>> m_profiles{};
+};
+
+inline CounterGroup::CounterGroup() {
+  struct Config {
+    std::uint32_t type{};
+    std::uint64_t config{};
+  };
+  constexpr auto cache = [](std::uint64_t id, std::uint64_t result) {
+    return id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+  };
+  const auto configs = std::array<Config, event_count>{
+      Config{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      Config{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      Config{PERF_TYPE_HW_CACHE,
+             cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+      Config{PERF_TYPE_HW_CACHE,
+             cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+      Config{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+  for (auto e = std::size_t{0}; e < event_count; ++e) {
+    auto attr = perf_event_attr{};
+    attr.size = sizeof(attr);
+    attr.type = configs[e].type;
+    attr.config = configs[e].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // the leader starts disabled, members follow it
+    if (m_leader < 0)
+      attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const auto fd = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+    if (fd < 0) {
+      if (m_error.empty())
+        m_error = std::strerror(errno);
+      continue;
+    }
+    if (m_leader < 0)
+      m_leader = fd;
+    m_fds[e] = fd;
+    m_slots[e] = m_open++;
+  }
+  if (m_leader >= 0) {
+    ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+inline auto CounterGroup::read() const noexcept -> Reading {
+  auto reading = Reading{
+      .ns = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch())
+              .count())};
+  if (m_leader < 0)
+    return reading;
+  // { nr, values[nr] }
+  auto buffer = std::array<std::uint64_t, 1 + event_count>{};
+  if (::read(m_leader, buffer.data(), sizeof(buffer)) <= 0)
+    return reading;
+  for (auto e = std::size_t{0}; e < event_count; ++e)
+    if (m_fds[e] >= 0)
+      reading.events[e] = buffer[1 + m_slots[e]];
+  return reading;
+}
+
+inline auto Session::profile() -> ThreadProfile* {
+  const auto lock = std::scoped_lock(m_mutex);
+  auto& profile = m_profiles[std::this_thread::get_id()];
+  if (!profile)
+    profile = std::make_unique<ThreadProfile>();
+  return profile.get();
+}
+
+inline auto Session::write_report(std::ostream& out) const -> void {
+  const auto lock = std::scoped_lock(m_mutex);
+  if (m_profiles.empty())
+    return;
+  auto phases = std::array<Reading, phase_count + 1>{};
+  auto calls = std::array<std::uint64_t, phase_count + 1>{};
+  auto rays = std::uint64_t{0};
+  const auto& counters = m_profiles.begin()->second->counters;
+  for (const auto& [id, profile] : m_profiles) {
+    auto attributed = Reading{};
+    for (auto p = std::size_t{0}; p < phase_count; ++p) {
+      phases[p] += profile->phases[p];
+      calls[p] += profile->calls[p];
+      attributed += profile->phases[p];
+    }
+    phases[phase_count] += profile->total - attributed;
+    rays += profile->rays;
+  }
+
+  if (!counters.error().empty())
+    out << "perf: some counters unavailable (" << counters.error()
+        << "), shown as n/a\n";
+  out << std::format("perf: {} threads, {} rays; figures per ray\n",
+                     m_profiles.size(), rays);
+  out << std::format("{:<14}{:>12}{:>10}{:>10}{:>10}{:>6}{:>9}{:>9}{:>9}\n",
+                     "phase", "calls", "ms", "cycles", "instr", "IPC", "L1D",
+                     "LLC", "br-miss");
+  const auto per_ray = [&counters, rays](const Reading& r, const Event e) {
+    if (!counters.available(e))
+      return std::string("n/a");
+    const auto v = static_cast<double>(r.events[static_cast<std::size_t>(e)]);
+    return std::format("{:.1f}", rays > 0 ? v / static_cast<double>(rays) : 0.);
+  };
+  for (auto p = std::size_t{0}; p <= phase_count; ++p) {
+    const auto& r = phases[p];
+    const auto ipc =
+        counters.available(Event::cycles) &&
+                counters.available(Event::instructions) && r.events[0] > 0
+            ? std::format("{:.2f}", static_cast<double>(r.events[1]) /
+                                        static_cast<double>(r.events[0]))
+            : std::string("n/a");
+    out << std::format(
+        "{:<14}{:>12}{:>10.1f}{:>10}{:>10}{:>6}{:>9}{:>9}{:>9}\n",
+        p < phase_count ? phase_names[p] : "other",
+        p < phase_count ? std::to_string(calls[p]) : std::string("-"),
+        static_cast<double>(r.ns) / 1e6, per_ray(r, Event::cycles),
+        per_ray(r, Event::instructions), ipc, per_ray(r, Event::l1d_misses),
+        per_ray(r, Event::llc_misses), per_ray(r, Event::branch_misses));
+  }
+}
+
+}  // namespace perf
+
+#endif  // !PERF_COUNTERS_HPP
@@ -0,0 +1,178 @@
+#ifndef RADIANCE_CACHE_HPP
+#define RADIANCE_CACHE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "color.hpp"
+#include "vec3.hpp"
+
+// Outgoing radiance of diffuse surfaces, averaged per cell of a spatial
+// hash grid over (position, normal). Filled online: every diffuse vertex
+// adds its path estimate, and once a cell holds `min_samples` of them,
+// paths that have already bounced diffusely stop there and use the mean.
+//
+// The bias is the radiance varying inside a cell, so `cell_size` trades
+// accuracy for speed. Lambertian outgoing radiance does not depend on the
+// viewer, which is what makes the entries reusable across paths.
+template <class T>
+class RadianceCache {
+ public:
+  static constexpr std::size_t default_capacity = std::size_t{1} << 20;
+  // Past this many samples a cell is left alone, which keeps hot cells
+  // from becoming atomic contention points.
+  static constexpr std::uint32_t max_samples = 1024;
+  // Probes before a lookup or record gives up on a crowded table.
+  static constexpr std::size_t max_probes = 8;
+
+  RadianceCache() = delete;
+  RadianceCache(const T& cell_size,
+                const std::uint32_t min_samples = 16,
+                const std::size_t capacity = default_capacity)
+      : m_inv_cell_size(T{1} / cell_size),
+        m_min_samples(min_samples),
+        m_mask(std::bit_ceil(capacity) - 1),
+        m_entries(std::make_unique<Entry[]>(m_mask + 1)) {};
+
+  [[nodiscard]] auto lookup(const Point3<T>& p,
+                            const Vec3<T>& normal) const noexcept
+      -> std::optional<Color<T>>;
+  auto record(const Point3<T>& p,
+              const Vec3<T>& normal,
+              const Color<T>& radiance) noexcept -> void;
+
+  struct Stats {
+    std::size_t cells{};
+    std::size_t converged{};
+    std::size_t capacity{};
+  };
+  // Scans the table; call between renders.
+  [[nodiscard]] auto stats() const noexcept -> Stats;
+
+ private:
+  // Key 0 marks a free slot. A reader racing a writer may pair a sum and
+  // a count one sample apart; the mean is off by that one sample.
+  struct Entry {
+    std::atomic<std::uint64_t> key{};
+    std::atomic<std::uint32_t> count{};
+    std::atomic<T> r{};
+    std::atomic<T> g{};
+    std::atomic<T> b{};
+  };
+
+  [[nodiscard]] auto key(const Point3<T>& p,
+                         const Vec3<T>& normal) const noexcept
+      -> std::uint64_t;
+  [[nodiscard]] auto find(const std::uint64_t key) const noexcept
+      -> Entry*;
+  [[nodiscard]] auto find_or_insert(const std::uint64_t key) noexcept
+      -> Entry*;
+
+  const T m_inv_cell_size{};
+  const std::uint32_t m_min_samples{};
+  const std::size_t m_mask{};
+  std::unique_ptr<Entry[]> m_entries{};
+};
+
+template <class T>
+auto RadianceCache<T>::lookup(const Point3<T>& p,
+                              const Vec3<T>& normal) const noexcept
+    -> std::optional<Color<T>> {
+  const auto* e = find(key(p, normal));
+  if (!e)
+    return std::nullopt;
+  const auto n = e->count.load(std::memory_order_relaxed);
+  if (n < m_min_samples)
+    return std::nullopt;
+  const auto scale = T{1} / static_cast<T>(n);
+  return Color<T>{e->r.load(std::memory_order_relaxed) * scale,
+                  e->g.load(std::memory_order_relaxed) * scale,
+                  e->b.load(std::memory_order_relaxed) * scale};
+}
+
+template <class T>
+auto RadianceCache<T>::record(const Point3<T>& p,
+                              const Vec3<T>& normal,
+                              const Color<T>& radiance) noexcept -> void {
+  if (!std::isfinite(radiance.x() + radiance.y() + radiance.z()))
+    return;
+  auto* e = find_or_insert(key(p, normal));
+  if (!e || e->count.load(std::memory_order_relaxed) >= max_samples)
+    return;
+  e->r.fetch_add(radiance.x(), std::memory_order_relaxed);
+  e->g.fetch_add(radiance.y(), std::memory_order_relaxed);
+  e->b.fetch_add(radiance.z(), std::memory_order_relaxed);
+  e->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class T>
+auto RadianceCache<T>::stats() const noexcept -> Stats {
+  auto stats = Stats{.capacity = m_mask + 1};
+  for (auto i = std::size_t{0}; i <= m_mask; ++i) {
+    if (m_entries[i].key.load(std::memory_order_relaxed) == 0)
+      continue;
+    ++stats.cells;
+    if (m_entries[i].count.load(std::memory_order_relaxed) >= m_min_samples)
+      ++stats.converged;
+  }
+  return stats;
+}
+
+// Cell coordinates and the normal rounded to a 5x5x5 lattice of
+// directions, mixed into 64 bits (splitmix64 finalizer).
+template <class T>
+auto RadianceCache<T>::key(const Point3<T>& p,
+                           const Vec3<T>& normal) const noexcept
+    -> std::uint64_t {
+  auto cell = [this](const T& x) {
+    return static_cast<std::uint64_t>(
+        static_cast<std::int64_t>(std::floor(x * m_inv_cell_size)));
+  };
+  auto direction = [](const T& x) {
+    return static_cast<std::uint64_t>(std::lround(x * 2) + 2);
+  };
+  auto h = cell(p.x()) * 0x9e3779b97f4a7c15ull;
+  h = (h ^ cell(p.y())) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ cell(p.z())) * 0x94d049bb133111ebull;
+  h ^= direction(normal.x()) | direction(normal.y()) << 3 |
+       direction(normal.z()) << 6;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h != 0 ? h : 1;
+}
+
+template <class T>
+auto RadianceCache<T>::find(const std::uint64_t key) const noexcept
+    -> Entry* {
+  for (auto i = std::size_t{0}; i < max_probes; ++i) {
+    auto& e = m_entries[(key + i) & m_mask];
+    const auto k = e.key.load(std::memory_order_acquire);
+    if (k == key)
+      return &e;
+    if (k == 0)
+      return nullptr;
+  }
+  return nullptr;
+}
+
+template <class T>
+auto RadianceCache<T>::find_or_insert(const std::uint64_t key) noexcept
+    -> Entry* {
+  for (auto i = std::size_t{0}; i < max_probes; ++i) {
+    auto& e = m_entries[(key + i) & m_mask];
+    auto k = e.key.load(std::memory_order_acquire);
+    if (k == 0 && e.key.compare_exchange_strong(k, key,
+                                                std::memory_order_acq_rel))
+      return &e;
+    if (k == key)
+      return &e;
+  }
+  return nullptr;
+}
+
+#endif  // !RADIANCE_CACHE_HPP
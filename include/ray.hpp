@@ -6,12 +6,26 @@
 template <class T>
 using Point3 = Vec3<T>;
 
+// Footprint of a ray as a cone: `width` at the origin, growing by `spread`
+// per unit of distance travelled. Used to pick texture mip levels.
+template <class T>
+struct RayCone {
+  T width{};
+  T spread{};
+
+  [[nodiscard]] auto width_at(const T& distance) const noexcept -> T {
+    return width + spread * distance;
+  }
+};
+
 template <class T>
 class Ray {
  public:
   Ray() {};
-  Ray(const Point3<T>& origin, const Vec3<T>& direction)
-      : m_origin(origin), m_direction(direction) {};
+  Ray(const Point3<T>& origin,
+      const Vec3<T>& direction,
+      const RayCone<T>& cone = {})
+      : m_origin(origin), m_direction(direction), m_cone(cone) {};
 
   [[nodiscard]] auto origin() const noexcept -> const Point3<T>& {
     return m_origin;
@@ -19,6 +33,9 @@ class Ray {
   [[nodiscard]] auto direction() const noexcept -> const Vec3<T>& {
     return m_direction;
   }
+  [[nodiscard]] auto cone() const noexcept -> const RayCone<T>& {
+    return m_cone;
+  }
 
   template <class Time_t>
   [[nodiscard]] auto at(Time_t&& t) const noexcept -> Point3<T> {
@@ -28,6 +45,7 @@ class Ray {
  private:
   Point3<T> m_origin;
   Vec3<T> m_direction;
+  RayCone<T> m_cone{};
 };
 
 #endif  // !RAY_HPP
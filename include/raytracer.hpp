@@ -0,0 +1,94 @@
+#ifndef RAYTRACER_HPP
+#define RAYTRACER_HPP
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stop_token>
+
+// Embedding API of the RayTracer library. Nothing here does I/O: images are
+// written as linear float RGB into memory owned by the caller.
+namespace raytracer {
+
+using Vec3d = std::array<double, 3>;
+
+struct MaterialDesc {
+  enum class Kind { lambertian, metal, dielectric };
+
+  Kind kind{Kind::lambertian};
+  Vec3d albedo{0.5, 0.5, 0.5};
+  double fuzz{};
+  double refraction_index{1.5};
+};
+
+class Scene {
+ public:
+  Scene();
+  Scene(Scene&&) noexcept;
+  auto operator=(Scene&&) noexcept -> Scene&;
+  ~Scene();
+
+  auto add_sphere(const Vec3d& center,
+                  const double radius,
+                  const MaterialDesc& material) -> void;
+
+  // The random sphere lattice of the book's final render.
+  [[nodiscard]] static auto book_cover() -> Scene;
+
+ private:
+  friend class Renderer;
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+struct CameraDesc {
+  Vec3d lookfrom{13, 2, 3};
+  Vec3d lookat{0, 0, 0};
+  Vec3d v_up{0, 1, 0};
+  double v_fov{20};
+  double defocus_angle{};
+  double focus_distance{10};
+  std::size_t samples_per_pixel{100};
+  int max_depth{50};
+};
+
+// RGB triples; `stride` is the distance between rows in floats, 0 means
+// tightly packed (3 * width).
+struct FramebufferView {
+  float* data{};
+  std::size_t width{};
+  std::size_t height{};
+  std::size_t stride{};
+};
+
+struct RenderCallbacks {
+  // Called on the rendering thread as tiles finish.
+  std::function<void(std::size_t done, std::size_t total)> progress{};
+  // Tiles not yet started are skipped once a stop is requested.
+  std::stop_token stop{};
+};
+
+enum class RenderStatus { done, cancelled, invalid_framebuffer };
+
+// Owns the worker threads; reuse one Renderer across calls to keep them.
+class Renderer {
+ public:
+  explicit Renderer(const std::size_t threads = 0);
+  Renderer(Renderer&&) noexcept;
+  auto operator=(Renderer&&) noexcept -> Renderer&;
+  ~Renderer();
+
+  auto render(const Scene& scene,
+              const CameraDesc& camera,
+              const FramebufferView& framebuffer,
+              const RenderCallbacks& callbacks = {}) -> RenderStatus;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+}  // namespace raytracer
+
+#endif  // !RAYTRACER_HPP
@@ -0,0 +1,344 @@
+#ifndef RENDER_SERVER_HPP
+#define RENDER_SERVER_HPP
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <sstream>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch.hpp"
+#include "camera.hpp"
+#include "color.hpp"
+#include "scene_cache.hpp"
+#include "thread_pool.hpp"
+#include "tile_stream.hpp"
+#include "unix_socket.hpp"
+
+// Long running render service on a Unix domain socket. Clients send one
+// request per line:
+//
+//   render <id> <priority> <scene> <width> <height> <samples>
+//          <lookfrom.xyz> <lookat.xyz> <v_fov>
+//   shutdown
+//
+// and get back, for every render, its tiles as they finish and then a
+// closing line:
+//
+//   tile <id> <x0> <y0> <x1> <y1>   followed by (x1-x0)*(y1-y0) RGB8 pixels
+//   done <id> <milliseconds> <hit|miss>
+//   error <id> <reason>
+//
+// Jobs from all clients share one queue, highest priority first and in
+// arrival order within a priority; each job's tiles then fan out over the
+// shared pool and stream back through stream_tiles. Scenes come from a
+// SceneCache, so repeated references skip the scene build. `shutdown`
+// finishes the queued jobs and returns, and so does an accept() failure
+// other than running out of descriptors, which only pauses accepting.
+template <class T>
+struct RenderJob {
+  std::string id{};
+  int priority{};
+  std::string scene{};
+  std::size_t width{};
+  std::size_t height{};
+  std::size_t samples{};
+  CameraView<T> view{};
+};
+
+// The fields after `render`; nullopt if any is missing or out of range.
+template <class T>
+[[nodiscard]] auto parse_render_job(const std::string& fields)
+    -> std::optional<RenderJob<T>> {
+  constexpr auto max_side = std::size_t{16384};
+  auto in = std::istringstream(fields);
+  auto job = RenderJob<T>{};
+  auto v = std::array<T, 7>{};
+  in >> job.id >> job.priority >> job.scene >> job.width >> job.height >>
+      job.samples;
+  for (auto& x : v)
+    in >> x;
+  if (!in || job.width == 0 || job.height == 0 || job.samples == 0 ||
+      job.width > max_side || job.height > max_side)
+    return std::nullopt;
+  job.view = CameraView<T>{.lookfrom = Point3<T>{v[0], v[1], v[2]},
+                           .lookat = Point3<T>{v[3], v[4], v[5]},
+                           .v_fov = v[6]};
+  return job;
+}
+
+template <class T>
+class RenderServer {
+ public:
+  using Image_t = std::size_t;
+  static constexpr Image_t tile_size = 16;
+
+  RenderServer() = delete;
+  RenderServer(ThreadPool& pool,
+               SceneCache<T>& scenes,
+               const CameraSettings<T, Image_t>& settings)
+      : m_pool(pool), m_scenes(scenes), m_settings(settings) {};
+
+  // Blocks until a client asks for shutdown or accepting fails. False if
+  // `path` cannot be listened on.
+  auto serve(const std::string& path) -> bool;
+
+ private:
+  // Writes from the dispatcher and the client's reader are serialized so
+  // tile headers and pixels never interleave.
+  struct Client {
+    UnixSocket socket;
+    std::mutex write_mutex{};
+    std::atomic<bool> connected{true};
+
+    auto send(const std::string& header,
+              std::span<const std::byte> payload = {}) -> void {
+      const auto lock = std::scoped_lock(write_mutex);
+      if (connected && !(socket.send(header) && socket.send(payload)))
+        connected = false;
+    }
+  };
+
+  // A client and the thread reading its requests; the thread raises
+  // `finished` just before it returns.
+  struct Connection {
+    std::shared_ptr<Client> client{};
+    std::shared_ptr<std::atomic<bool>> finished{};
+    std::jthread reader{};
+  };
+
+  struct Queued {
+    RenderJob<T> job{};
+    std::shared_ptr<Client> client{};
+    std::uint64_t sequence{};
+
+    // priority_queue pops the largest
+    [[nodiscard]] auto operator<(const Queued& other) const noexcept
+        -> bool {
+      if (job.priority != other.job.priority)
+        return job.priority < other.job.priority;
+      return sequence > other.sequence;
+    }
+  };
+
+  auto read_requests(const std::shared_ptr<Client>& client) -> void;
+  // Whether serve() should keep accepting after accept() failed.
+  [[nodiscard]] auto accept_failed(const int error) -> bool;
+  auto dispatch(std::stop_token stop) -> void;
+  auto render(const Queued& queued) -> void;
+  auto request_shutdown() -> void;
+
+  ThreadPool& m_pool;
+  SceneCache<T>& m_scenes;
+  const CameraSettings<T, Image_t> m_settings;
+
+  const UnixSocket* m_listener{};
+  std::mutex m_mutex{};
+  std::condition_variable_any m_queue_cv{};
+  std::priority_queue<Queued> m_queue{};
+  std::uint64_t m_next_sequence{};
+  bool m_shutting_down{};
+};
+
+template <class T>
+auto RenderServer<T>::serve(const std::string& path) -> bool {
+  const auto listener = UnixSocket::listen(path);
+  if (!listener)
+    return false;
+  m_listener = &listener.value();
+  std::clog << "serving on " << path << "\n";
+
+  auto connections = std::vector<Connection>{};
+  auto dispatcher =
+      std::jthread([this](std::stop_token stop) { dispatch(stop); });
+  while (true) {
+    // Readers of clients that hung up are joined here; their sockets close
+    // once no queued job refers to them either.
+    std::erase_if(connections, [](const Connection& connection) {
+      return connection.finished->load(std::memory_order_acquire);
+    });
+    auto socket = listener->accept();
+    if (!socket) {
+      if (accept_failed(errno))
+        continue;
+      break;
+    }
+    auto client = std::make_shared<Client>(std::move(socket.value()));
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    connections.push_back(Connection{
+        .client = client,
+        .finished = finished,
+        .reader = std::jthread([this, client, finished] {
+          read_requests(client);
+          finished->store(true, std::memory_order_release);
+        })});
+  }
+
+  // The listener was shut down: drain the queue, then hang up on everyone
+  // so their readers return.
+  dispatcher.request_stop();
+  dispatcher.join();
+  for (const auto& connection : connections)
+    connection.client->socket.shutdown();
+  connections.clear();
+  m_listener = nullptr;
+  return true;
+}
+
+// Interrupted calls and connections reset before they were accepted are
+// retried at once. Out of descriptors or memory, accepting pauses so the
+// loop does not spin while jobs finish and clients hang up; anything else
+// stops the server as if a client had asked it to.
+template <class T>
+auto RenderServer<T>::accept_failed(const int error) -> bool {
+  {
+    const auto lock = std::scoped_lock(m_mutex);
+    if (m_shutting_down)
+      return false;
+  }
+  switch (error) {
+    case EINTR:
+    case ECONNABORTED:
+      return true;
+    case EMFILE:
+    case ENFILE:
+    case ENOBUFS:
+    case ENOMEM:
+      std::this_thread::sleep_for(std::chrono::milliseconds{100});
+      return true;
+    default:
+      std::clog << "accept failed: " << std::strerror(error)
+                << ", shutting down\n";
+      const auto lock = std::scoped_lock(m_mutex);
+      m_shutting_down = true;
+      return false;
+  }
+}
+
+template <class T>
+auto RenderServer<T>::read_requests(const std::shared_ptr<Client>& client)
+    -> void {
+  while (const auto line = client->socket.read_line()) {
+    auto in = std::istringstream(line.value());
+    auto command = std::string{};
+    in >> command;
+    if (command == "shutdown") {
+      request_shutdown();
+      break;
+    }
+    auto fields = std::string{};
+    std::getline(in, fields);
+    const auto job = command == "render"
+                         ? parse_render_job<T>(fields)
+                         : std::optional<RenderJob<T>>{};
+    if (!job) {
+      client->send("error - malformed request\n");
+      continue;
+    }
+    {
+      const auto lock = std::scoped_lock(m_mutex);
+      if (m_shutting_down) {
+        client->send(std::format("error {} shutting down\n", job->id));
+        continue;
+      }
+      m_queue.push(Queued{.job = job.value(),
+                          .client = client,
+                          .sequence = m_next_sequence++});
+    }
+    m_queue_cv.notify_one();
+  }
+}
+
+template <class T>
+auto RenderServer<T>::request_shutdown() -> void {
+  {
+    const auto lock = std::scoped_lock(m_mutex);
+    m_shutting_down = true;
+  }
+  m_listener->shutdown();
+}
+
+// One job at a time: its tiles already keep every worker busy, and
+// finishing jobs in order is what makes the priorities mean something.
+template <class T>
+auto RenderServer<T>::dispatch(std::stop_token stop) -> void {
+  while (true) {
+    auto queued = Queued{};
+    {
+      auto lock = std::unique_lock(m_mutex);
+      // Stopping still drains what was queued before the shutdown.
+      m_queue_cv.wait(lock, stop, [this] { return !m_queue.empty(); });
+      if (m_queue.empty())
+        return;
+      queued = m_queue.top();
+      m_queue.pop();
+    }
+    if (queued.client->connected)
+      render(queued);
+  }
+}
+
+template <class T>
+auto RenderServer<T>::render(const Queued& queued) -> void {
+  const auto& job = queued.job;
+  auto& client = *queued.client;
+  const auto start = std::chrono::steady_clock::now();
+  const auto lookup = m_scenes.get(job.scene);
+  if (!lookup) {
+    client.send(std::format("error {} unknown scene {}\n", job.id, job.scene));
+    return;
+  }
+
+  // Camera derives its height from the aspect ratio by truncation; aim at
+  // the middle of the requested row.
+  auto settings = m_settings;
+  settings.image_width = job.width;
+  settings.aspect_ratio =
+      static_cast<T>(job.width) / (static_cast<T>(job.height) + T{0.5});
+  settings.samples_per_pixel = job.samples;
+  const auto camera = make_camera(settings, job.view.lookfrom,
+                                  job.view.lookat, job.view.v_fov);
+  const auto& world = *lookup->scene;
+  // Tiles go out from here as the pool finishes them; a slow client holds
+  // the workers back, and one that hung up cancels the rest of the job.
+  for (auto&& rendered : stream_tiles(m_pool, world, camera, tile_size,
+                                      2 * m_pool.size())) {
+    const auto& tile = rendered.tile;
+    auto pixels = std::vector<std::byte>{};
+    pixels.reserve(3 * rendered.pixels.size());
+    for (const auto& c : rendered.pixels)
+      for (const auto byte : to_rgb8(c))
+        pixels.push_back(static_cast<std::byte>(byte));
+    client.send(std::format("tile {} {} {} {} {}\n", job.id, tile.x0,
+                            tile.y0, tile.x1, tile.y1),
+                pixels);
+    if (!client.connected)
+      break;
+  }
+
+  const auto ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  const auto cache = lookup->hit ? "hit" : "miss";
+  client.send(std::format("done {} {:.1f} {}\n", job.id, ms, cache));
+  std::clog << std::format("job {} ({}, priority {}): {}x{}, {:.1f} ms, "
+                           "scene cache {}\n",
+                           job.id, job.scene, job.priority, job.width,
+                           job.height, ms, cache);
+}
+
+#endif  // !RENDER_SERVER_HPP
@@ -0,0 +1,183 @@
+#ifndef RENDER_STATS_HPP
+#define RENDER_STATS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "tiles.hpp"
+
+namespace render_stats {
+// Bumped by the integrator; a tile's cost is the difference across it.
+struct Counters {
+  std::uint64_t rays{};
+  std::uint64_t paths{};
+};
+inline thread_local Counters counters{};
+
+// Small dense id per thread, used as the trace "tid".
+[[nodiscard]] inline auto thread_index() noexcept -> std::size_t {
+  static std::atomic<std::size_t> next{0};
+  thread_local const auto index = next++;
+  return index;
+}
+}  // namespace render_stats
+
+template <class Image_t>
+struct TileCost {
+  Tile<Image_t> tile{};
+  std::size_t thread{};
+  double start_us{};
+  double duration_us{};
+  std::uint64_t rays{};
+  std::uint64_t paths{};
+
+  [[nodiscard]] auto average_depth() const noexcept -> double {
+    return paths > 0 ? static_cast<double>(rays) / static_cast<double>(paths)
+                     : 0.;
+  }
+};
+
+// Records time, rays and path depth per tile, and writes them out as a
+// false color heatmap and as a Chrome trace_event timeline.
+template <class Image_t>
+class RenderProfiler {
+ public:
+  RenderProfiler() : m_origin(clock::now()) {};
+
+  template <class Fn>
+  auto profile_tile(const Tile<Image_t>& tile, Fn&& fn) -> void;
+
+  [[nodiscard]] auto tiles() const noexcept
+      -> const std::vector<TileCost<Image_t>>& {
+    return m_tiles;
+  }
+  auto write_summary(std::ostream& out) const -> void;
+  auto write_heatmap(std::ostream& out,
+                     const Image_t& width,
+                     const Image_t& height) const -> void;
+  auto write_chrome_trace(std::ostream& out) const -> void;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  [[nodiscard]] auto since_origin(const clock::time_point& t) const noexcept
+      -> double {
+    return std::chrono::duration<double, std::micro>(t - m_origin).count();
+  }
+  [[nodiscard]] static auto false_color(const double v) noexcept
+      -> std::array<int, 3>;
+
+  clock::time_point m_origin{};
+  std::mutex m_mutex{};
+  std::vector<TileCost<Image_t>> m_tiles{};
+};
+
+template <class Image_t>
+template <class Fn>
+auto RenderProfiler<Image_t>::profile_tile(const Tile<Image_t>& tile, Fn&& fn)
+    -> void {
+  const auto before = render_stats::counters;
+  const auto start = clock::now();
+  fn();
+  const auto end = clock::now();
+  const auto after = render_stats::counters;
+
+  const auto cost =
+      TileCost<Image_t>{.tile = tile,
+                        .thread = render_stats::thread_index(),
+                        .start_us = since_origin(start),
+                        .duration_us = since_origin(end) - since_origin(start),
+                        .rays = after.rays - before.rays,
+                        .paths = after.paths - before.paths};
+  const auto lock = std::lock_guard(m_mutex);
+  m_tiles.push_back(cost);
+}
+
+template <class Image_t>
+auto RenderProfiler<Image_t>::write_summary(std::ostream& out) const -> void {
+  if (m_tiles.empty())
+    return;
+  const auto [min, max] =
+      std::ranges::minmax(m_tiles, {}, &TileCost<Image_t>::duration_us);
+  auto add = [](auto acc, const auto& t) {
+    return std::array{acc[0] + t.duration_us,
+                      acc[1] + static_cast<double>(t.rays),
+                      acc[2] + static_cast<double>(t.paths)};
+  };
+  const auto sum = std::ranges::fold_left(m_tiles, std::array{0., 0., 0.}, add);
+  const auto count = static_cast<double>(m_tiles.size());
+  out << "tiles: " << m_tiles.size() << ", ms min/avg/max: "
+      << min.duration_us / 1e3 << " / " << sum[0] / count / 1e3 << " / "
+      << max.duration_us / 1e3 << ", rays: " << sum[1]
+      << ", avg path depth: " << (sum[2] > 0 ? sum[1] / sum[2] : 0.) << "\n";
+}
+
+// Time per pixel of each tile, normalized to the most expensive tile.
+template <class Image_t>
+auto RenderProfiler<Image_t>::write_heatmap(std::ostream& out,
+                                            const Image_t& width,
+                                            const Image_t& height) const
+    -> void {
+  auto cost = std::vector<double>(static_cast<std::size_t>(width * height));
+  auto peak = 0.;
+  for (const auto& t : m_tiles) {
+    const auto area = std::max<Image_t>(t.tile.area(), 1);
+    const auto per_pixel = t.duration_us / static_cast<double>(area);
+    peak = std::max(peak, per_pixel);
+    std::ranges::for_each(t.tile.pixels(), [&](auto&& p) {
+      cost[static_cast<std::size_t>(p.second * width + p.first)] = per_pixel;
+    });
+  }
+
+  out << "P3\n" << width << ' ' << height << "\n255\n";
+  for (const auto c : cost) {
+    const auto [r, g, b] = false_color(peak > 0 ? c / peak : 0.);
+    out << r << ' ' << g << ' ' << b << '\n';
+  }
+}
+
+template <class Image_t>
+auto RenderProfiler<Image_t>::write_chrome_trace(std::ostream& out) const
+    -> void {
+  out << "{\"traceEvents\":[\n";
+  auto first = true;
+  for (const auto& t : m_tiles) {
+    out << (first ? "" : ",\n") << "{\"name\":\"tile " << t.tile.x0 << ","
+        << t.tile.y0 << "\",\"cat\":\"render\",\"ph\":\"X\",\"pid\":0,"
+        << "\"tid\":" << t.thread << ",\"ts\":" << std::llround(t.start_us)
+        << ",\"dur\":" << std::llround(t.duration_us)
+        << ",\"args\":{\"rays\":" << t.rays
+        << ",\"avg_depth\":" << t.average_depth() << "}}";
+    first = false;
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+// Black -> purple -> orange -> yellow -> white.
+template <class Image_t>
+auto RenderProfiler<Image_t>::false_color(const double v) noexcept
+    -> std::array<int, 3> {
+  constexpr auto stops = std::array<std::array<double, 3>, 5>{
+      {{0, 0, 0},
+       {87, 16, 110},
+       {229, 92, 48},
+       {252, 210, 37},
+       {255, 255, 255}}};
+  const auto x = std::clamp(v, 0., 1.) * static_cast<double>(stops.size() - 1);
+  const auto lo = std::min(static_cast<std::size_t>(x), stops.size() - 2);
+  const auto s = x - static_cast<double>(lo);
+  auto channel = [&](std::size_t c) {
+    return static_cast<int>(
+        std::lround(stops[lo][c] + s * (stops[lo + 1][c] - stops[lo][c])));
+  };
+  return {channel(0), channel(1), channel(2)};
+}
+
+#endif  // !RENDER_STATS_HPP
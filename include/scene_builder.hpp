@@ -0,0 +1,80 @@
+#ifndef SCENE_BUILDER_HPP
+#define SCENE_BUILDER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "hittable_list.hpp"
+
+// Builds a HittableList of millions of objects in one pass. The list's
+// storage is sized to the full capacity up front, in one allocation, and
+// filled with empty placeholder spheres; threads claim disjoint runs of
+// slots and move-assign their objects, each built as a temporary
+// Hittable_t, over the placeholders, with no lock and no allocation per
+// object. `build` hands that storage to the list as it is, so the objects
+// are not copied or moved again, and objects added afterwards up to the
+// capacity do not reallocate it either. Materials are held by value
+// inside the primitives and come along with them.
+//
+// There is no arena: a std::vector cannot adopt objects constructed in
+// memory it did not allocate, so staging them in one costs a second copy
+// of the scene and a move pass, and a pmr vector over an arena would
+// still need its slots constructed before the workers fill them. The
+// placeholders are written by the constructing thread, so that is the
+// NUMA node the pages land on; --numa-replicate copies the list per node.
+//
+// Every claimed slot must be emplaced before `build`.
+template <class T>
+class SceneBuilder {
+ public:
+  SceneBuilder() = delete;
+  explicit SceneBuilder(const std::size_t capacity)
+      : m_objects(capacity,
+                  Sphere<T>{Point3<T>{}, T{0}, Material_t<T>{}}) {};
+
+  // `count` consecutive slots, by the index of the first; nullopt once the
+  // capacity would be exceeded. Safe from any thread.
+  [[nodiscard]] auto claim(const std::size_t count) noexcept
+      -> std::optional<std::size_t>;
+  // Builds the object of a claimed slot and move-assigns it over the
+  // placeholder. Threads may emplace into different slots at the same
+  // time.
+  template <class... Args>
+  auto emplace(const std::size_t slot, Args&&... args) -> void {
+    m_objects[slot] = Hittable_t<T>(std::forward<Args>(args)...);
+  }
+
+  [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+    return m_objects.size();
+  }
+  // Hands the claimed objects over; the builder is spent afterwards.
+  [[nodiscard]] auto build() -> HittableList<T>;
+
+ private:
+  std::vector<Hittable_t<T>> m_objects{};
+  std::atomic<std::size_t> m_claimed{};
+};
+
+template <class T>
+auto SceneBuilder<T>::claim(const std::size_t count) noexcept
+    -> std::optional<std::size_t> {
+  auto first = m_claimed.load(std::memory_order_relaxed);
+  do {
+    if (count > m_objects.size() - first)
+      return std::nullopt;
+  } while (!m_claimed.compare_exchange_weak(first, first + count,
+                                            std::memory_order_relaxed));
+  return first;
+}
+
+// Unclaimed slots are dropped from the end; the capacity stays.
+template <class T>
+auto SceneBuilder<T>::build() -> HittableList<T> {
+  const auto claimed = static_cast<std::ptrdiff_t>(m_claimed.load());
+  m_objects.erase(m_objects.begin() + claimed, m_objects.end());
+  return HittableList<T>(std::move(m_objects));
+}
+
+#endif  // !SCENE_BUILDER_HPP
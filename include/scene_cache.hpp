@@ -0,0 +1,90 @@
+#ifndef SCENE_CACHE_HPP
+#define SCENE_CACHE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "hittable_list.hpp"
+
+// Built scenes, acceleration structures included, keyed by the reference
+// they were built from. The least recently used one is dropped once more
+// than `capacity` are kept; renders still holding it keep it alive.
+template <class T>
+class SceneCache {
+ public:
+  using Scene_ptr = std::shared_ptr<const HittableList<T>>;
+  // nullopt for a reference it does not understand
+  using Builder =
+      std::function<std::optional<HittableList<T>>(const std::string&)>;
+
+  struct Lookup {
+    Scene_ptr scene{};
+    bool hit{};
+  };
+
+  SceneCache() = delete;
+  SceneCache(const std::size_t capacity, Builder builder)
+      : m_capacity(std::max<std::size_t>(capacity, 1)),
+        m_builder(std::move(builder)) {};
+
+  // Builds on a miss, outside the lock, so a slow build does not stall
+  // hits on other scenes.
+  [[nodiscard]] auto get(const std::string& reference)
+      -> std::optional<Lookup>;
+
+  [[nodiscard]] auto size() const -> std::size_t {
+    const auto lock = std::scoped_lock(m_mutex);
+    return m_lru.size();
+  }
+
+ private:
+  using Entry = std::pair<std::string, Scene_ptr>;
+
+  const std::size_t m_capacity{};
+  const Builder m_builder{};
+  mutable std::mutex m_mutex{};
+  // most recently used first
+  std::list<Entry> m_lru{};
+  std::unordered_map<std::string, typename std::list<Entry>::iterator>
+      m_index{};
+};
+
+template <class T>
+auto SceneCache<T>::get(const std::string& reference)
+    -> std::optional<Lookup> {
+  {
+    const auto lock = std::scoped_lock(m_mutex);
+    if (const auto it = m_index.find(reference); it != m_index.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      return Lookup{.scene = it->second->second, .hit = true};
+    }
+  }
+
+  auto built = m_builder(reference);
+  if (!built)
+    return std::nullopt;
+  auto scene = std::make_shared<const HittableList<T>>(std::move(*built));
+
+  const auto lock = std::scoped_lock(m_mutex);
+  // Someone else may have built it meanwhile; keep theirs.
+  if (const auto it = m_index.find(reference); it != m_index.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return Lookup{.scene = it->second->second, .hit = true};
+  }
+  m_lru.emplace_front(reference, scene);
+  m_index[reference] = m_lru.begin();
+  if (m_lru.size() > m_capacity) {
+    m_index.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+  return Lookup{.scene = std::move(scene), .hit = false};
+}
+
+#endif  // !SCENE_CACHE_HPP
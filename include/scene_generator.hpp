@@ -0,0 +1,342 @@
+#ifndef SCENE_GENERATOR_HPP
+#define SCENE_GENERATOR_HPP
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "color.hpp"
+#include "globals.hpp"
+#include "hit_record.hpp"
+#include "hittables/compact_sphere_set.hpp"
+#include "hittables/sphere.hpp"
+#include "thread_pool.hpp"
+#include "vec3.hpp"
+
+enum class Distribution { uniform, clustered, layered };
+
+// Everything that shapes a generated scene; the same parameters give the
+// same scene on any machine and with any number of threads.
+template <class T>
+struct SceneParameters {
+  std::size_t count{484};
+  Distribution distribution{Distribution::uniform};
+  T min_radius{0.2};
+  T max_radius{0.2};
+  // Relative weights of matte, metal and glass spheres.
+  std::array<T, 3> material_mix{T{0.7}, T{0.2}, T{0.1}};
+  std::uint64_t seed{1};
+  // Half the side of the square the spheres cover; 0 keeps the book's
+  // density of one sphere per unit of area.
+  T extent{0};
+  std::size_t clusters{64};
+  std::size_t layers{4};
+  // Distinct materials; spheres index into them.
+  std::size_t palette{4096};
+};
+
+// `count=100000000,distribution=clustered,radius=0.05:0.3,mix=7:2:1,seed=3`
+// with any subset of count, distribution (uniform, clustered, layered),
+// radius (min:max), mix (matte:metal:glass), seed, extent, clusters,
+// layers and palette; nullopt on anything else.
+template <class T>
+[[nodiscard]] auto parse_scene_parameters(std::string_view spec)
+    -> std::optional<SceneParameters<T>>;
+
+// SplitMix64: tiny state and good enough statistics for placing spheres,
+// and cheap to seed per chunk.
+class SplitMix64 {
+ public:
+  explicit SplitMix64(const std::uint64_t seed) : m_state(seed) {};
+
+  auto next() noexcept -> std::uint64_t {
+    auto z = (m_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  // [0, 1) from as many top bits as T has mantissa bits, so the draw is
+  // exact in T: a double rounded to float could come out as 1.
+  template <class T>
+  auto uniform() noexcept -> T {
+    constexpr auto bits = std::numeric_limits<T>::digits;
+    constexpr auto scale = T{1} / static_cast<T>(std::uint64_t{1} << bits);
+    return static_cast<T>(next() >> (64 - bits)) * scale;
+  }
+  template <class T>
+  auto uniform(const T& min, const T& max) noexcept -> T {
+    return min + (max - min) * uniform<T>();
+  }
+  auto below(const std::size_t n) noexcept -> std::size_t {
+    return static_cast<std::size_t>(next() % n);
+  }
+
+ private:
+  std::uint64_t m_state{};
+};
+
+// Seeded, parallel sphere scenes for scaling studies. Spheres are made in
+// fixed chunks, each from its own generator seeded by (seed, chunk), so
+// chunks can be produced on any thread in any order and still come out
+// the same. Large scenes are written straight into their final packed
+// array, or handed chunk by chunk to a sink without ever being held whole.
+template <class T>
+class SceneGenerator {
+ public:
+  static constexpr std::size_t chunk_size = std::size_t{1} << 16;
+
+  SceneGenerator() = delete;
+  explicit SceneGenerator(const SceneParameters<T>& parameters)
+      : m_parameters(parameters),
+        m_extent(parameters.extent > 0
+                     ? parameters.extent
+                     : std::sqrt(static_cast<T>(parameters.count)) / 2),
+        m_cluster_centers(make_cluster_centers()) {};
+
+  [[nodiscard]] auto parameters() const noexcept
+      -> const SceneParameters<T>& {
+    return m_parameters;
+  }
+  // The palette PackedSphere::material indexes.
+  [[nodiscard]] auto materials() const -> std::vector<Material_t<T>>;
+
+  // sink(first_index, spheres) for every chunk, called on the pool's
+  // workers; memory stays at one chunk per worker.
+  template <class Sink>
+  auto for_each_chunk(ThreadPool& pool, Sink&& sink) const -> void;
+  [[nodiscard]] auto packed(ThreadPool& pool) const
+      -> std::vector<PackedSphere>;
+  [[nodiscard]] auto compact_set(ThreadPool& pool) const
+      -> CompactSphereSet<T>;
+  [[nodiscard]] auto spheres(ThreadPool& pool) const
+      -> std::vector<Sphere<T>>;
+
+ private:
+  [[nodiscard]] auto chunk_count() const noexcept -> std::size_t {
+    return (m_parameters.count + chunk_size - 1) / chunk_size;
+  }
+  auto generate_chunk(const std::size_t chunk,
+                      std::span<PackedSphere> out) const noexcept -> void;
+  [[nodiscard]] auto make_cluster_centers() const
+      -> std::vector<std::array<T, 2>>;
+  [[nodiscard]] auto seed_for(const std::uint64_t stream,
+                              const std::uint64_t index) const noexcept
+      -> std::uint64_t {
+    return SplitMix64(m_parameters.seed ^ (stream << 56) ^ index).next();
+  }
+
+  const SceneParameters<T> m_parameters;
+  const T m_extent{};
+  const std::vector<std::array<T, 2>> m_cluster_centers{};
+};
+
+template <class T>
+auto parse_scene_parameters(std::string_view spec)
+    -> std::optional<SceneParameters<T>> {
+  auto p = SceneParameters<T>{};
+  auto number = [](std::string_view text, auto& out) {
+    const auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && end == text.data() + text.size();
+  };
+  // "a:b:c" into exactly out.size() numbers
+  auto numbers = [&number](std::string_view text, auto&& out) {
+    for (auto i = std::size_t{0}; i < out.size(); ++i) {
+      const auto colon = text.find(':');
+      const auto last = i + 1 == out.size();
+      if ((colon == std::string_view::npos) != last ||
+          !number(text.substr(0, colon), out[i]))
+        return false;
+      text = last ? std::string_view{} : text.substr(colon + 1);
+    }
+    return true;
+  };
+
+  while (!spec.empty()) {
+    const auto comma = spec.find(',');
+    const auto field = spec.substr(0, comma);
+    spec = comma == std::string_view::npos ? std::string_view{}
+                                           : spec.substr(comma + 1);
+    const auto equals = field.find('=');
+    if (equals == std::string_view::npos)
+      return std::nullopt;
+    const auto key = field.substr(0, equals);
+    const auto value = field.substr(equals + 1);
+    auto ok = false;
+    if (key == "count") {
+      ok = number(value, p.count) && p.count > 0 &&
+           p.count <= CompactSphereSet<T>::max_primitives;
+    } else if (key == "distribution") {
+      ok = true;
+      if (value == "uniform")
+        p.distribution = Distribution::uniform;
+      else if (value == "clustered")
+        p.distribution = Distribution::clustered;
+      else if (value == "layered")
+        p.distribution = Distribution::layered;
+      else
+        ok = false;
+    } else if (key == "radius") {
+      auto r = std::array<T, 2>{};
+      ok = numbers(value, r) && r[0] > 0 && r[0] <= r[1];
+      p.min_radius = r[0];
+      p.max_radius = r[1];
+    } else if (key == "mix") {
+      ok = numbers(value, p.material_mix) &&
+           std::ranges::all_of(p.material_mix, [](T w) { return w >= 0; }) &&
+           p.material_mix[0] + p.material_mix[1] + p.material_mix[2] > 0;
+    } else if (key == "seed") {
+      ok = number(value, p.seed);
+    } else if (key == "extent") {
+      ok = number(value, p.extent) && p.extent > 0;
+    } else if (key == "clusters") {
+      ok = number(value, p.clusters) && p.clusters > 0;
+    } else if (key == "layers") {
+      ok = number(value, p.layers) && p.layers > 0;
+    } else if (key == "palette") {
+      ok = number(value, p.palette) && p.palette > 0 &&
+           p.palette <= CompactSphereSet<T>::max_materials;
+    }
+    if (!ok)
+      return std::nullopt;
+  }
+  return p;
+}
+
+// The book's material parameters, drawn in the proportions of the mix.
+template <class T>
+auto SceneGenerator<T>::materials() const -> std::vector<Material_t<T>> {
+  const auto& mix = m_parameters.material_mix;
+  const auto total = mix[0] + mix[1] + mix[2];
+  auto materials = std::vector<Material_t<T>>{};
+  materials.reserve(m_parameters.palette);
+  for (auto i = std::size_t{0}; i < m_parameters.palette; ++i) {
+    auto rng = SplitMix64(seed_for(1, i));
+    auto color = [&rng](const T& min, const T& max) {
+      return Color<T>{rng.uniform(min, max), rng.uniform(min, max),
+                      rng.uniform(min, max)};
+    };
+    const auto pick = rng.uniform(T{0}, total);
+    if (pick < mix[0])
+      materials.emplace_back(Lambertian<T>{color(0, 1) * color(0, 1)});
+    else if (pick < mix[0] + mix[1])
+      materials.emplace_back(
+          Metal<T>{color(T{0.5}, 1), rng.uniform(T{0}, T{0.5})});
+    else
+      materials.emplace_back(Dielectric<T>{T{1.5}});
+  }
+  return materials;
+}
+
+template <class T>
+template <class Sink>
+auto SceneGenerator<T>::for_each_chunk(ThreadPool& pool, Sink&& sink) const
+    -> void {
+  for (auto chunk = std::size_t{0}; chunk < chunk_count(); ++chunk)
+    pool.submit([this, &sink, chunk] {
+      const auto first = chunk * chunk_size;
+      thread_local auto buffer = std::vector<PackedSphere>{};
+      buffer.resize(std::min(chunk_size, m_parameters.count - first));
+      generate_chunk(chunk, buffer);
+      sink(first, std::span<const PackedSphere>(buffer));
+    });
+  pool.wait();
+}
+
+template <class T>
+auto SceneGenerator<T>::packed(ThreadPool& pool) const
+    -> std::vector<PackedSphere> {
+  auto spheres = std::vector<PackedSphere>(m_parameters.count);
+  const auto all = std::span(spheres);
+  for (auto chunk = std::size_t{0}; chunk < chunk_count(); ++chunk)
+    pool.submit([this, all, chunk] {
+      const auto first = chunk * chunk_size;
+      generate_chunk(chunk, all.subspan(first, std::min(chunk_size,
+                                                        all.size() - first)));
+    });
+  pool.wait();
+  return spheres;
+}
+
+template <class T>
+auto SceneGenerator<T>::compact_set(ThreadPool& pool) const
+    -> CompactSphereSet<T> {
+  return CompactSphereSet<T>{packed(pool), materials()};
+}
+
+template <class T>
+auto SceneGenerator<T>::spheres(ThreadPool& pool) const
+    -> std::vector<Sphere<T>> {
+  const auto palette = materials();
+  auto spheres = std::vector<Sphere<T>>{};
+  spheres.reserve(m_parameters.count);
+  for (const auto& s : packed(pool))
+    spheres.emplace_back(Point3<T>{static_cast<T>(s.x), static_cast<T>(s.y),
+                                   static_cast<T>(s.z)},
+                         static_cast<T>(s.radius), palette[s.material]);
+  return spheres;
+}
+
+// Every sphere rests on (uniform, clustered) or floats above (layered)
+// the ground plane y = 0.
+template <class T>
+auto SceneGenerator<T>::generate_chunk(
+    const std::size_t chunk,
+    std::span<PackedSphere> out) const noexcept -> void {
+  const auto& p = m_parameters;
+  auto rng = SplitMix64(seed_for(0, chunk));
+  // Clusters hold a quarter of the area between them.
+  const auto sigma =
+      m_extent / std::sqrt(static_cast<T>(p.clusters)) / 4;
+  const auto layer_height = 4 * p.max_radius;
+  for (auto& sphere : out) {
+    const auto radius = rng.uniform(p.min_radius, p.max_radius);
+    auto x = T{0};
+    auto y = radius;
+    auto z = T{0};
+    if (p.distribution == Distribution::clustered) {
+      const auto [cx, cz] = m_cluster_centers[rng.below(p.clusters)];
+      // Box-Muller
+      const auto r = sigma * std::sqrt(-2 * std::log(1 - rng.uniform<T>()));
+      const auto phi = 2 * globals::pi<T> * rng.uniform<T>();
+      x = cx + r * std::cos(phi);
+      z = cz + r * std::sin(phi);
+    } else {
+      x = rng.uniform(-m_extent, m_extent);
+      z = rng.uniform(-m_extent, m_extent);
+      if (p.distribution == Distribution::layered)
+        y += static_cast<T>(rng.below(p.layers)) * layer_height;
+    }
+    sphere = PackedSphere{
+        .x = static_cast<float>(x),
+        .y = static_cast<float>(y),
+        .z = static_cast<float>(z),
+        .radius = static_cast<float>(radius),
+        .material = static_cast<std::uint16_t>(rng.below(p.palette))};
+  }
+}
+
+template <class T>
+auto SceneGenerator<T>::make_cluster_centers() const
+    -> std::vector<std::array<T, 2>> {
+  auto centers = std::vector<std::array<T, 2>>{};
+  if (m_parameters.distribution != Distribution::clustered)
+    return centers;
+  auto rng = SplitMix64(seed_for(2, 0));
+  centers.resize(m_parameters.clusters);
+  for (auto& [x, z] : centers) {
+    x = rng.uniform(-m_extent, m_extent);
+    z = rng.uniform(-m_extent, m_extent);
+  }
+  return centers;
+}
+
+#endif  // !SCENE_GENERATOR_HPP
@@ -0,0 +1,269 @@
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <variant>
+#include <vector>
+#include "camera.hpp"
+#include "camera_keys.hpp"
+#include "framebuffer.hpp"
+#include "hit_record.hpp"
+#include "hittable_list.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+#include "vec3.hpp"
+
+template <class T>
+struct CameraKey {
+  T time{};
+  Point3<T> lookfrom{};
+  Point3<T> lookat{};
+  T v_fov{};
+};
+
+// Keyframes sorted by time, linearly interpolated in between.
+template <class T>
+class CameraPath {
+ public:
+  CameraPath() = delete;
+  CameraPath(std::vector<CameraKey<T>> keys) : m_keys(std::move(keys)) {
+    std::ranges::sort(m_keys, {}, &CameraKey<T>::time);
+  };
+
+  [[nodiscard]] auto start() const noexcept -> T {
+    return m_keys.front().time;
+  }
+  [[nodiscard]] auto end() const noexcept -> T { return m_keys.back().time; }
+  [[nodiscard]] auto at(const T& time) const noexcept -> CameraKey<T>;
+
+ private:
+  std::vector<CameraKey<T>> m_keys{};
+};
+
+template <class T>
+auto CameraPath<T>::at(const T& time) const noexcept -> CameraKey<T> {
+  const auto next = std::ranges::upper_bound(m_keys, time, {},
+                                             &CameraKey<T>::time);
+  if (next == m_keys.begin())
+    return m_keys.front();
+  if (next == m_keys.end())
+    return m_keys.back();
+
+  const auto& a = *std::prev(next);
+  const auto& b = *next;
+  const auto s = (time - a.time) / (b.time - a.time);
+  return CameraKey<T>{.time = time,
+                      .lookfrom = a.lookfrom + s * (b.lookfrom - a.lookfrom),
+                      .lookat = a.lookat + s * (b.lookat - a.lookat),
+                      .v_fov = a.v_fov + s * (b.v_fov - a.v_fov)};
+}
+
+// One key per line: `time lookfrom.xyz lookat.xyz v_fov`, '#' starts a
+// comment.
+template <class T>
+[[nodiscard]] auto parse_camera_path(std::istream& in)
+    -> std::optional<CameraPath<T>> {
+  const auto lines = parse_key_lines<T, 8>(in);
+  if (!lines)
+    return std::nullopt;
+  auto keys = std::vector<CameraKey<T>>{};
+  for (const auto& v : lines.value())
+    keys.push_back(CameraKey<T>{.time = v[0],
+                                .lookfrom = Point3<T>{v[1], v[2], v[3]},
+                                .lookat = Point3<T>{v[4], v[5], v[6]},
+                                .v_fov = v[7]});
+  return CameraPath<T>{std::move(keys)};
+}
+
+template <class T, class Image_t>
+struct SequenceSettings {
+  CameraSettings<T, Image_t> camera{};
+  // fresh samples for pixels whose history survived reprojection
+  std::size_t reuse_samples{};
+  // cap on carried-over samples so lighting changes still fade in
+  std::size_t max_history{};
+  // disocclusion threshold, relative to the distance from the camera
+  T position_tolerance{};
+  Image_t tile_size{};
+};
+
+// Renders a keyframed fly-through with one scene and one pool. Each pixel
+// reprojects its primary hit into the previous frame and, when the surface
+// there matches, continues that pixel's running mean with only a few fresh
+// samples.
+template <class T, class Image_t>
+class SequenceRenderer {
+ public:
+  SequenceRenderer() = delete;
+  SequenceRenderer(ThreadPool& pool,
+                   const HittableList<T>& world,
+                   const SequenceSettings<T, Image_t>& settings)
+      : m_pool(pool), m_world(world), m_settings(settings) {};
+
+  // sink(frame_index, framebuffer) is called on the caller's thread.
+  template <class FrameSink>
+  auto render(const CameraPath<T>& path,
+              const std::size_t frames,
+              FrameSink&& sink) -> void;
+
+ private:
+  using Camera_t = Camera<T, Image_t>;
+
+  struct History {
+    Color<T> color{};
+    T samples{};
+    Point3<T> position{};
+    Vec3<T> normal{};
+    bool reusable{};
+  };
+
+  auto render_tile(const Camera_t& camera,
+                   const CameraKey<T>& key,
+                   const std::optional<Camera_t>& previous,
+                   const Tile<Image_t>& tile,
+                   Framebuffer<T, Image_t>& frame) -> void;
+  [[nodiscard]] auto reproject(const Camera_t& previous,
+                               const CameraKey<T>& key,
+                               const HitRecord<T>& hit_record) const noexcept
+      -> const History*;
+  [[nodiscard]] static auto view_independent(
+      const Material_t<T>& material) noexcept -> bool {
+    return std::holds_alternative<Lambertian<T>>(material);
+  }
+
+  ThreadPool& m_pool;
+  const HittableList<T>& m_world;
+  const SequenceSettings<T, Image_t> m_settings;
+  std::vector<History> m_history{};
+  std::vector<History> m_previous{};
+  std::atomic<std::size_t> m_reused_pixels{};
+  std::atomic<std::size_t> m_fresh_samples{};
+};
+
+template <class T, class Image_t>
+template <class FrameSink>
+auto SequenceRenderer<T, Image_t>::render(const CameraPath<T>& path,
+                                          const std::size_t frames,
+                                          FrameSink&& sink) -> void {
+  auto previous = std::optional<Camera_t>{};
+  for (auto f = std::size_t{0}; f < frames; ++f) {
+    const auto s = frames > 1 ? static_cast<T>(f) / static_cast<T>(frames - 1)
+                              : T{0};
+    const auto key = path.at(path.start() + s * (path.end() - path.start()));
+    const auto camera =
+        make_camera(m_settings.camera, key.lookfrom, key.lookat, key.v_fov);
+    const auto pixels = static_cast<std::size_t>(camera.width() *
+                                                 camera.height());
+    m_history.assign(pixels, History{});
+    m_previous.resize(pixels);
+    m_reused_pixels = 0;
+    m_fresh_samples = 0;
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    auto frame = Framebuffer<T, Image_t>(camera.width(), camera.height());
+    for (const auto& tile :
+         make_tiles(camera.width(), camera.height(), m_settings.tile_size))
+      m_pool.submit([this, &camera, &key, &previous, tile, &frame] {
+        render_tile(camera, key, previous, tile, frame);
+      });
+    m_pool.wait();
+    const auto end_time = std::chrono::high_resolution_clock::now();
+
+    std::clog << "frame " << f << ": reused " << m_reused_pixels << "/"
+              << pixels << " pixels, "
+              << static_cast<double>(m_fresh_samples) /
+                     static_cast<double>(pixels)
+              << " fresh spp, took "
+              << std::chrono::duration<float>(end_time - start_time).count()
+              << " s\n";
+    sink(f, frame);
+
+    std::swap(m_history, m_previous);
+    previous.emplace(camera);
+  }
+}
+
+template <class T, class Image_t>
+auto SequenceRenderer<T, Image_t>::render_tile(
+    const Camera_t& camera,
+    const CameraKey<T>& key,
+    const std::optional<Camera_t>& previous,
+    const Tile<Image_t>& tile,
+    Framebuffer<T, Image_t>& frame) -> void {
+  auto reused = std::size_t{0};
+  auto fresh_total = std::size_t{0};
+  for (const auto pixel : tile.pixels()) {
+    const auto [i, j] = pixel;
+    const auto hit_record = camera.primary_hit(m_world, pixel);
+    const auto* history = (previous && hit_record)
+                              ? reproject(previous.value(), key, *hit_record)
+                              : nullptr;
+
+    const auto carried =
+        history ? std::min(history->samples,
+                           static_cast<T>(m_settings.max_history))
+                : T{0};
+    const auto fresh = history ? m_settings.reuse_samples
+                               : m_settings.camera.samples_per_pixel;
+    const auto sampled = camera.pixel_color(m_world, pixel, fresh);
+    const auto total = carried + static_cast<T>(fresh);
+    const auto color =
+        history ? (history->color * carried + sampled * static_cast<T>(fresh)) /
+                      total
+                : sampled;
+
+    reused += history ? 1 : 0;
+    fresh_total += fresh;
+    frame.at(i, j) = color;
+    m_history[static_cast<std::size_t>(j * camera.width() + i)] = History{
+        .color = color,
+        .samples = total,
+        .position = hit_record ? hit_record->p : Point3<T>{},
+        .normal = hit_record ? hit_record->normal : Vec3<T>{},
+        .reusable = hit_record && view_independent(hit_record->mat)};
+  }
+  m_reused_pixels += reused;
+  m_fresh_samples += fresh_total;
+}
+
+// History is rejected when the surface moved off screen, when another
+// surface now covers it (disocclusion), or when its shading depends on the
+// view direction.
+template <class T, class Image_t>
+auto SequenceRenderer<T, Image_t>::reproject(
+    const Camera_t& previous,
+    const CameraKey<T>& key,
+    const HitRecord<T>& hit_record) const noexcept -> const History* {
+  if (!view_independent(hit_record.mat))
+    return nullptr;
+  const auto projected = previous.project(hit_record.p);
+  if (!projected)
+    return nullptr;
+
+  const auto x = std::round(projected->first);
+  const auto y = std::round(projected->second);
+  if (x < 0 || y < 0 || x >= static_cast<T>(previous.width()) ||
+      y >= static_cast<T>(previous.height()))
+    return nullptr;
+
+  const auto index = static_cast<std::size_t>(y) *
+                         static_cast<std::size_t>(previous.width()) +
+                     static_cast<std::size_t>(x);
+  const auto& history = m_previous[index];
+  const auto distance = (hit_record.p - key.lookfrom).length();
+  const auto moved = (history.position - hit_record.p).length();
+  if (!history.reusable || moved > m_settings.position_tolerance * distance ||
+      dot(history.normal, hit_record.normal) < T{0.9})
+    return nullptr;
+  return &history;
+}
+
+#endif  // !SEQUENCE_HPP
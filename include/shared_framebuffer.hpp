@@ -0,0 +1,311 @@
+#ifndef SHARED_FRAMEBUFFER_HPP
+#define SHARED_FRAMEBUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "async_writer.hpp"
+#include "color.hpp"
+#include "tiles.hpp"
+
+// Float RGB accumulation buffer in a POSIX shared memory segment, so that
+// viewers in other processes can map it and watch a render converge
+// without a copy going through a pipe or socket. The segment holds:
+//
+//   Header           dimensions, pass and sample counts, a finished flag
+//   generation[n]    one counter per tile of make_tiles(width, height,
+//                    tile_size), a cache line each
+//   texels           width x height running means, row-major
+//
+// The renderer writes each tile under its counter as a seqlock: odd while
+// the tile is being written, even once it is whole. A viewer reads the
+// counter, then the texels, then the counter again, and keeps the tile if
+// both reads saw the same even value. Writers never wait for viewers.
+class SharedFramebuffer {
+ public:
+  using Texel = std::array<float, 3>;
+
+  struct alignas(64) Header {
+    static constexpr std::uint32_t magic_value = 0x42465452;  // "RTFB"
+    static constexpr std::uint32_t current_version = 1;
+
+    // Stored last by `create`, so a viewer that sees it sees the rest.
+    std::atomic<std::uint32_t> magic{};
+    std::uint32_t version{};
+    std::uint32_t width{};
+    std::uint32_t height{};
+    std::uint32_t tile_size{};
+    std::uint32_t tiles{};
+    std::uint32_t total_passes{};
+    std::uint32_t total_samples{};
+    // passes every tile has finished, and their samples per pixel
+    std::atomic<std::uint32_t> passes{};
+    std::atomic<std::uint32_t> samples{};
+    std::atomic<std::uint32_t> finished{};
+  };
+
+  SharedFramebuffer() = delete;
+  SharedFramebuffer(const SharedFramebuffer&) = delete;
+  auto operator=(const SharedFramebuffer&) -> SharedFramebuffer& = delete;
+  SharedFramebuffer(SharedFramebuffer&& other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)) {};
+  ~SharedFramebuffer() {
+    if (m_data)
+      munmap(m_data, m_size);
+  }
+
+  // Creates the segment `name` for a render, replacing any segment of that
+  // name; viewers still mapping the old one keep it until they unmap.
+  [[nodiscard]] static auto create(const std::string& name,
+                                   const std::uint32_t width,
+                                   const std::uint32_t height,
+                                   const std::uint32_t tile_size,
+                                   const std::uint32_t total_passes,
+                                   const std::uint32_t total_samples)
+      -> std::optional<SharedFramebuffer>;
+  // Maps an existing segment read-only, for viewers. Fails until `create`
+  // has finished the header.
+  [[nodiscard]] static auto open(const std::string& name)
+      -> std::optional<SharedFramebuffer>;
+  // The segment outlives the renderer; whoever is done with it removes it.
+  static auto unlink(const std::string& name) noexcept -> bool;
+
+  [[nodiscard]] auto header() const noexcept -> const Header& {
+    return *static_cast<const Header*>(m_data);
+  }
+  // The tiles, in generation counter order.
+  [[nodiscard]] auto tiles() const -> std::vector<Tile<std::uint32_t>> {
+    return make_tiles(header().width, header().height, header().tile_size);
+  }
+  // Even once tile `index` is whole; bumped by 2 on every write.
+  [[nodiscard]] auto generation(const std::size_t index) const noexcept
+      -> std::uint64_t {
+    return generations()[index].value.load(std::memory_order_acquire);
+  }
+  // The running means in place, for readers that tolerate torn tiles.
+  [[nodiscard]] auto texels() const noexcept -> std::span<const Texel> {
+    return std::span(texel_data(), pixel_count());
+  }
+
+  // Blends one pass of tile `index` into the running means with `weight`,
+  // the pass's share of the samples so far. `pixels` is row-major,
+  // tile.area() of them.
+  template <class T, class Image_t>
+  auto accumulate(const std::size_t index,
+                  const Tile<Image_t>& tile,
+                  std::span<const Color<T>> pixels,
+                  const float weight) noexcept -> void;
+  auto finish_pass(const std::uint32_t samples) noexcept -> void;
+  auto finish() noexcept -> void;
+
+  // Copies the texels of tile `index` into `out` (row-major, tile.area()
+  // of them); false if the renderer wrote the tile meanwhile.
+  auto read_tile(const std::size_t index,
+                 const Tile<std::uint32_t>& tile,
+                 std::span<Texel> out) const noexcept -> bool;
+
+  template <class T>
+  auto write_ppm(std::ostream& out) const -> void;
+
+ private:
+  struct alignas(64) Generation {
+    std::atomic<std::uint64_t> value{};
+  };
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                "counters shared between processes must be lock-free");
+
+  SharedFramebuffer(void* data, const std::size_t size)
+      : m_data(data), m_size(size) {};
+
+  [[nodiscard]] static auto segment_name(const std::string& name)
+      -> std::string {
+    return name.starts_with('/') ? name : '/' + name;
+  }
+  [[nodiscard]] static auto segment_size(const std::uint32_t width,
+                                         const std::uint32_t height,
+                                         const std::size_t tiles) noexcept
+      -> std::size_t {
+    return sizeof(Header) + tiles * sizeof(Generation) +
+           std::size_t{width} * height * sizeof(Texel);
+  }
+  [[nodiscard]] auto generations() const noexcept -> Generation* {
+    return reinterpret_cast<Generation*>(static_cast<std::byte*>(m_data) +
+                                         sizeof(Header));
+  }
+  [[nodiscard]] auto texel_data() const noexcept -> Texel* {
+    return reinterpret_cast<Texel*>(generations() + header().tiles);
+  }
+  [[nodiscard]] auto pixel_count() const noexcept -> std::size_t {
+    return std::size_t{header().width} * header().height;
+  }
+  [[nodiscard]] auto mutable_header() noexcept -> Header& {
+    return *static_cast<Header*>(m_data);
+  }
+
+  void* m_data{};
+  std::size_t m_size{};
+};
+
+inline auto SharedFramebuffer::create(const std::string& name,
+                                      const std::uint32_t width,
+                                      const std::uint32_t height,
+                                      const std::uint32_t tile_size,
+                                      const std::uint32_t total_passes,
+                                      const std::uint32_t total_samples)
+    -> std::optional<SharedFramebuffer> {
+  if (width == 0 || height == 0 || tile_size == 0)
+    return std::nullopt;
+  const auto tiles = make_tiles(width, height, tile_size).size();
+  const auto size = segment_size(width, height, tiles);
+
+  // A fresh segment rather than truncating the old one under its viewers,
+  // which would fault on the pages cut off.
+  const auto path = segment_name(name);
+  shm_unlink(path.c_str());
+  const auto fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return std::nullopt;
+  const auto mapped =
+      ftruncate(fd, static_cast<off_t>(size)) == 0
+          ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+          : MAP_FAILED;
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    return std::nullopt;
+  }
+
+  auto framebuffer = SharedFramebuffer(mapped, size);
+  auto& header = *std::construct_at(static_cast<Header*>(mapped));
+  header.version = Header::current_version;
+  header.width = width;
+  header.height = height;
+  header.tile_size = tile_size;
+  header.tiles = static_cast<std::uint32_t>(tiles);
+  header.total_passes = total_passes;
+  header.total_samples = total_samples;
+  for (auto k = std::size_t{0}; k < tiles; ++k)
+    std::construct_at(framebuffer.generations() + k);
+  header.magic.store(Header::magic_value, std::memory_order_release);
+  return framebuffer;
+}
+
+// The size is checked against the header, so a segment from another
+// build or a truncated one is refused rather than read past its end.
+inline auto SharedFramebuffer::open(const std::string& name)
+    -> std::optional<SharedFramebuffer> {
+  const auto fd = shm_open(segment_name(name).c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return std::nullopt;
+  struct stat status{};
+  const auto size = fstat(fd, &status) == 0
+                        ? static_cast<std::size_t>(status.st_size)
+                        : std::size_t{0};
+  const auto mapped = size >= sizeof(Header)
+                          ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                          : MAP_FAILED;
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return std::nullopt;
+
+  auto framebuffer = SharedFramebuffer(mapped, size);
+  const auto& header = framebuffer.header();
+  if (header.magic.load(std::memory_order_acquire) != Header::magic_value ||
+      header.version != Header::current_version ||
+      header.tiles !=
+          make_tiles(header.width, header.height, header.tile_size).size() ||
+      size != segment_size(header.width, header.height, header.tiles))
+    return std::nullopt;
+  return framebuffer;
+}
+
+inline auto SharedFramebuffer::unlink(const std::string& name) noexcept
+    -> bool {
+  return shm_unlink(segment_name(name).c_str()) == 0;
+}
+
+// The counter goes odd before the first texel store and even after the
+// last; the fences keep the stores between them. One writer per tile.
+template <class T, class Image_t>
+auto SharedFramebuffer::accumulate(const std::size_t index,
+                                   const Tile<Image_t>& tile,
+                                   std::span<const Color<T>> pixels,
+                                   const float weight) noexcept -> void {
+  auto& generation = generations()[index].value;
+  const auto start = generation.load(std::memory_order_relaxed);
+  generation.store(start + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const auto width = static_cast<std::size_t>(tile.x1 - tile.x0);
+  for (auto k = std::size_t{0}; k < pixels.size(); ++k) {
+    const auto x = static_cast<std::size_t>(tile.x0) + k % width;
+    const auto y = static_cast<std::size_t>(tile.y0) + k / width;
+    auto& texel = texel_data()[y * header().width + x];
+    const auto& c = pixels[k];
+    texel[0] += (static_cast<float>(c.x()) - texel[0]) * weight;
+    texel[1] += (static_cast<float>(c.y()) - texel[1]) * weight;
+    texel[2] += (static_cast<float>(c.z()) - texel[2]) * weight;
+  }
+
+  generation.store(start + 2, std::memory_order_release);
+}
+
+inline auto SharedFramebuffer::finish_pass(const std::uint32_t samples) noexcept
+    -> void {
+  auto& header = mutable_header();
+  header.samples.store(samples, std::memory_order_relaxed);
+  header.passes.fetch_add(1, std::memory_order_release);
+}
+
+inline auto SharedFramebuffer::finish() noexcept -> void {
+  mutable_header().finished.store(1, std::memory_order_release);
+}
+
+inline auto SharedFramebuffer::read_tile(const std::size_t index,
+                                         const Tile<std::uint32_t>& tile,
+                                         std::span<Texel> out) const noexcept
+    -> bool {
+  const auto& generation = generations()[index].value;
+  const auto before = generation.load(std::memory_order_acquire);
+  if (before % 2 != 0)
+    return false;
+  auto k = std::size_t{0};
+  for (auto y = tile.y0; y < tile.y1; ++y)
+    for (auto x = tile.x0; x < tile.x1; ++x)
+      out[k++] = texel_data()[std::size_t{y} * header().width + x];
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return generation.load(std::memory_order_relaxed) == before;
+}
+
+// The texels as they are; meant for after the render, or for a renderer
+// writing out its own finished image.
+template <class T>
+auto SharedFramebuffer::write_ppm(std::ostream& out) const -> void {
+  const auto width = std::size_t{header().width};
+  const auto height = std::size_t{header().height};
+  auto writer = AsyncRowWriter<T>(out, width, height);
+  for (auto y = std::size_t{0}; y < height; ++y) {
+    auto row = std::vector<Color<T>>{};
+    row.reserve(width);
+    for (const auto& texel : texels().subspan(y * width, width))
+      row.emplace_back(static_cast<T>(texel[0]), static_cast<T>(texel[1]),
+                       static_cast<T>(texel[2]));
+    writer.push(std::move(row));
+  }
+  writer.finish();
+}
+
+#endif  // !SHARED_FRAMEBUFFER_HPP
@@ -0,0 +1,127 @@
+#ifndef MAPPED_IMAGE_HPP
+#define MAPPED_IMAGE_HPP
+
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary PPM (P6, 8 bits per channel) mapped read-only. Only the header is
+// parsed up front; pixel pages are faulted in by the OS as tiles touch
+// them, so opening a huge texture costs nothing until it is sampled.
+class MappedImage {
+ public:
+  MappedImage() = delete;
+  MappedImage(const MappedImage&) = delete;
+  auto operator=(const MappedImage&) -> MappedImage& = delete;
+  MappedImage(MappedImage&& other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_pixels(other.m_pixels),
+        m_width(other.m_width),
+        m_height(other.m_height) {};
+  ~MappedImage() {
+    if (m_data)
+      munmap(m_data, m_size);
+  }
+
+  [[nodiscard]] static auto open(const std::filesystem::path& path)
+      -> std::optional<MappedImage>;
+
+  [[nodiscard]] auto width() const noexcept -> std::size_t { return m_width; }
+  [[nodiscard]] auto height() const noexcept -> std::size_t {
+    return m_height;
+  }
+  [[nodiscard]] auto texel(const std::size_t x, const std::size_t y)
+      const noexcept -> std::array<std::uint8_t, 3> {
+    const auto* p = m_pixels + 3 * (y * m_width + x);
+    return {p[0], p[1], p[2]};
+  }
+
+ private:
+  MappedImage(void* data, const std::size_t size)
+      : m_data(data), m_size(size) {};
+
+  // Header fields longer than this are refused rather than overflowed.
+  static constexpr std::size_t max_digits = 9;
+
+  // Reads one header field, skipping whitespace and '#' comments.
+  [[nodiscard]] auto header_field(std::size_t& pos) const noexcept
+      -> std::optional<std::size_t>;
+
+  void* m_data{};
+  std::size_t m_size{};
+  const std::uint8_t* m_pixels{};
+  std::size_t m_width{};
+  std::size_t m_height{};
+};
+
+inline auto MappedImage::open(const std::filesystem::path& path)
+    -> std::optional<MappedImage> {
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+  struct stat info {};
+  const auto mapped =
+      fstat(fd, &info) == 0 && info.st_size > 0
+          ? mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ,
+                 MAP_PRIVATE, fd, 0)
+          : MAP_FAILED;
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return std::nullopt;
+
+  auto image = MappedImage(mapped, static_cast<std::size_t>(info.st_size));
+  const auto* bytes = static_cast<const std::uint8_t*>(mapped);
+  if (image.m_size < 2 || bytes[0] != 'P' || bytes[1] != '6')
+    return std::nullopt;
+  auto pos = std::size_t{2};
+  const auto width = image.header_field(pos);
+  const auto height = image.header_field(pos);
+  const auto max_value = image.header_field(pos);
+  // Exactly one whitespace byte separates the header from the pixels. The
+  // size check divides, so huge dimensions cannot wrap it around.
+  if (!width || !height || max_value != 255 || width == 0 || height == 0 ||
+      pos + 1 > image.m_size ||
+      width.value() > (image.m_size - pos - 1) / 3 / height.value())
+    return std::nullopt;
+
+  image.m_width = width.value();
+  image.m_height = height.value();
+  image.m_pixels = bytes + pos + 1;
+  return image;
+}
+
+inline auto MappedImage::header_field(std::size_t& pos) const noexcept
+    -> std::optional<std::size_t> {
+  const auto* bytes = static_cast<const std::uint8_t*>(m_data);
+  while (pos < m_size) {
+    if (bytes[pos] == '#') {
+      while (pos < m_size && bytes[pos] != '\n')
+        ++pos;
+    } else if (std::isspace(bytes[pos])) {
+      ++pos;
+    } else {
+      break;
+    }
+  }
+  auto value = std::size_t{0};
+  const auto start = pos;
+  while (pos < m_size && std::isdigit(bytes[pos])) {
+    if (pos - start == max_digits)
+      return std::nullopt;
+    value = value * 10 + static_cast<std::size_t>(bytes[pos++] - '0');
+  }
+  if (pos == start)
+    return std::nullopt;
+  return value;
+}
+
+#endif  // !MAPPED_IMAGE_HPP
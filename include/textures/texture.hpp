@@ -0,0 +1,35 @@
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <variant>
+#include "color.hpp"
+#include "fn_cpp_helper.hpp"
+#include "textures/texture_cache.hpp"
+
+// An image in a shared TextureCache; the cache must outlive the material.
+template <class T>
+struct ImageTexture {
+  TextureCache* cache{};
+  TextureCache::TextureId id{};
+};
+
+// Surface albedo: a constant or an image looked up by uv.
+template <class T>
+using Albedo_t = std::variant<Color<T>, ImageTexture<T>>;
+
+template <class T>
+[[nodiscard]] auto albedo_at(const Albedo_t<T>& albedo,
+                             const T& u,
+                             const T& v,
+                             const T& footprint) noexcept -> Color<T> {
+  return std::visit(
+      overloaded{
+          [](const Color<T>& c) { return c; },
+          [&](const ImageTexture<T>& t) {
+            return t.cache->sample(t.id, u, v, footprint);
+          },
+      },
+      albedo);
+}
+
+#endif  // !TEXTURE_HPP
@@ -0,0 +1,403 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "color.hpp"
+#include "textures/mapped_image.hpp"
+
+// Fixed-budget cache of 32x32 texel tiles over every mip level of a set of
+// mapped textures. Nothing is read when a texture is added: a base level
+// tile is copied from the mapped file on first use, and a coarser tile is
+// built on first use from the 2x2 tiles under it on the level below, the
+// resident ones read from the cache and the others built the same way.
+// Tiles of every level share the budget and the eviction order, so memory
+// stays bounded however many textures there are.
+//
+// Reads do not lock: a texture's tile directory maps each tile to a
+// (slot, generation) pair, and readers validate the slot's generation
+// around the texel load like a seqlock. A miss builds the tile without any
+// lock, then takes the mutex only to pick a slot by a CLOCK sweep
+// (approximate LRU, whose reference bit readers set without locking) and
+// publish the tile there.
+//
+// Textures must be added before rendering starts.
+class TextureCache {
+ public:
+  using TextureId = std::uint32_t;
+  static constexpr std::size_t tile_size = 32;
+  static constexpr std::size_t tile_texels = tile_size * tile_size;
+  static constexpr std::size_t tile_bytes =
+      tile_texels * sizeof(std::uint32_t);
+
+  struct Stats {
+    std::size_t loaded{};
+    std::size_t evicted{};
+    std::size_t resident{};
+    std::size_t capacity{};
+  };
+
+  TextureCache() = delete;
+  explicit TextureCache(const std::size_t budget_bytes)
+      : m_capacity(std::max<std::size_t>(budget_bytes / tile_bytes, 1)),
+        m_slots(std::make_unique<Slot[]>(m_capacity)),
+        m_texels(std::make_unique<std::atomic<std::uint32_t>[]>(
+            m_capacity * tile_texels)) {};
+
+  [[nodiscard]] auto add(const std::filesystem::path& path)
+      -> std::optional<TextureId>;
+
+  // Bilinear lookup on the mip level matching `footprint`, the width of
+  // the ray's footprint in uv units. u wraps, v is clamped; v = 0 is the
+  // bottom row.
+  template <class T>
+  [[nodiscard]] auto sample(const TextureId id,
+                            const T& u,
+                            const T& v,
+                            const T& footprint) noexcept -> Color<T>;
+
+  [[nodiscard]] auto stats() const noexcept -> Stats;
+
+ private:
+  using Tile_t = std::array<std::uint32_t, tile_texels>;
+
+  struct Level {
+    std::size_t width{};
+    std::size_t height{};
+    std::size_t tiles_x{};
+    std::size_t first_tile{};
+  };
+
+  // Directory entries are (generation << 32) | (slot + 1), 0 when the
+  // tile is not resident. Tiles are numbered across all levels.
+  struct Texture {
+    MappedImage image;
+    std::vector<Level> levels{};
+    std::unique_ptr<std::atomic<std::uint64_t>[]> directory{};
+  };
+
+  struct Slot {
+    // odd while the tile is being written
+    std::atomic<std::uint32_t> generation{};
+    std::atomic<bool> referenced{};
+    // owner, guarded by the mutex
+    const Texture* texture{};
+    std::size_t tile{};
+  };
+
+  [[nodiscard]] auto texel(Texture& texture,
+                           const std::size_t level,
+                           const std::size_t x,
+                           const std::size_t y) noexcept -> std::uint32_t;
+  // A copy of a resident tile, nullopt if it is not resident or is
+  // evicted during the copy.
+  [[nodiscard]] auto resident_tile(const Texture& texture,
+                                   const std::size_t tile) noexcept
+      -> std::optional<Tile_t>;
+  [[nodiscard]] auto build_tile(const Texture& texture,
+                                const std::size_t level,
+                                const std::size_t tile) noexcept -> Tile_t;
+  // Called with the mutex held.
+  [[nodiscard]] auto publish(Texture& texture,
+                             const std::size_t tile,
+                             const Tile_t& texels) noexcept -> std::size_t;
+  [[nodiscard]] auto next_victim() noexcept -> std::size_t;
+
+  [[nodiscard]] static auto pack(const std::array<std::uint8_t, 3>& rgb) noexcept
+      -> std::uint32_t {
+    return static_cast<std::uint32_t>(rgb[0]) |
+           static_cast<std::uint32_t>(rgb[1]) << 8 |
+           static_cast<std::uint32_t>(rgb[2]) << 16;
+  }
+  [[nodiscard]] static auto channel(const std::uint32_t texel,
+                                    const int c) noexcept -> std::uint8_t {
+    return static_cast<std::uint8_t>(texel >> (8 * c));
+  }
+  // Mean of four texels in linear space (texels are stored gamma 2, like
+  // the output images).
+  [[nodiscard]] static auto average(
+      const std::array<std::uint32_t, 4>& texels) noexcept -> std::uint32_t;
+
+  const std::size_t m_capacity{};
+  std::unique_ptr<Slot[]> m_slots{};
+  std::unique_ptr<std::atomic<std::uint32_t>[]> m_texels{};
+  std::vector<std::unique_ptr<Texture>> m_textures{};
+
+  mutable std::mutex m_mutex{};
+  std::size_t m_hand{};
+  std::size_t m_loaded{};
+  std::size_t m_evicted{};
+  std::size_t m_resident{};
+};
+
+inline auto TextureCache::add(const std::filesystem::path& path)
+    -> std::optional<TextureId> {
+  auto image = MappedImage::open(path);
+  if (!image)
+    return std::nullopt;
+
+  auto levels = std::vector<Level>{};
+  auto width = image->width();
+  auto height = image->height();
+  auto tiles = std::size_t{0};
+  while (true) {
+    const auto tiles_x = (width + tile_size - 1) / tile_size;
+    const auto tiles_y = (height + tile_size - 1) / tile_size;
+    levels.push_back(Level{.width = width,
+                           .height = height,
+                           .tiles_x = tiles_x,
+                           .first_tile = tiles});
+    tiles += tiles_x * tiles_y;
+    if (width == 1 && height == 1)
+      break;
+    width = std::max<std::size_t>(width / 2, 1);
+    height = std::max<std::size_t>(height / 2, 1);
+  }
+
+  const auto lock = std::scoped_lock(m_mutex);
+  m_textures.push_back(std::make_unique<Texture>(
+      Texture{.image = std::move(image.value()),
+              .levels = std::move(levels),
+              .directory =
+                  std::make_unique<std::atomic<std::uint64_t>[]>(tiles)}));
+  return static_cast<TextureId>(m_textures.size() - 1);
+}
+
+template <class T>
+auto TextureCache::sample(const TextureId id,
+                          const T& u,
+                          const T& v,
+                          const T& footprint) noexcept -> Color<T> {
+  auto& texture = *m_textures[id];
+  const auto& base = texture.levels.front();
+  const auto texels = footprint * static_cast<T>(std::max(base.width,
+                                                          base.height));
+  const auto lod = texels > 1 ? std::log2(texels) : T{0};
+  const auto coarsest = static_cast<T>(texture.levels.size() - 1);
+  const auto level = static_cast<std::size_t>(std::min(lod, coarsest));
+  const auto& l = texture.levels[level];
+
+  const auto x = (u - std::floor(u)) * static_cast<T>(l.width) - T{0.5};
+  const auto y = (1 - std::clamp<T>(v, 0, 1)) * static_cast<T>(l.height) -
+                 T{0.5};
+  const auto x0 = std::floor(x);
+  const auto y0 = std::floor(y);
+  const auto fx = x - x0;
+  const auto fy = y - y0;
+  const auto w = static_cast<long long>(l.width);
+  const auto h = static_cast<long long>(l.height);
+  auto wrap_x = [w](long long i) {
+    return static_cast<std::size_t>(((i % w) + w) % w);
+  };
+  auto clamp_y = [h](long long j) {
+    return static_cast<std::size_t>(std::clamp<long long>(j, 0, h - 1));
+  };
+  auto decode = [](std::uint32_t t) {
+    auto linear = [t](int c) {
+      const auto s = static_cast<T>(channel(t, c)) / 255;
+      return s * s;
+    };
+    return Color<T>{linear(0), linear(1), linear(2)};
+  };
+
+  const auto i = static_cast<long long>(x0);
+  const auto j = static_cast<long long>(y0);
+  auto at = [&](long long di, long long dj) {
+    return decode(texel(texture, level, wrap_x(i + di), clamp_y(j + dj)));
+  };
+  return (1 - fy) * ((1 - fx) * at(0, 0) + fx * at(1, 0)) +
+         fy * ((1 - fx) * at(0, 1) + fx * at(1, 1));
+}
+
+inline auto TextureCache::stats() const noexcept -> Stats {
+  const auto lock = std::scoped_lock(m_mutex);
+  return Stats{.loaded = m_loaded,
+               .evicted = m_evicted,
+               .resident = m_resident,
+               .capacity = m_capacity};
+}
+
+inline auto TextureCache::texel(Texture& texture,
+                                const std::size_t level,
+                                const std::size_t x,
+                                const std::size_t y) noexcept
+    -> std::uint32_t {
+  const auto& l = texture.levels[level];
+  const auto tile = l.first_tile + (y / tile_size) * l.tiles_x + x / tile_size;
+  const auto offset = (y % tile_size) * tile_size + x % tile_size;
+
+  const auto entry = texture.directory[tile].load(std::memory_order_acquire);
+  if (entry != 0) {
+    const auto slot = static_cast<std::size_t>(entry & 0xffffffffu) - 1;
+    const auto generation = static_cast<std::uint32_t>(entry >> 32);
+    auto& s = m_slots[slot];
+    if (s.generation.load(std::memory_order_acquire) == generation) {
+      const auto value = m_texels[slot * tile_texels + offset].load(
+          std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.generation.load(std::memory_order_relaxed) == generation) {
+        if (!s.referenced.load(std::memory_order_relaxed))
+          s.referenced.store(true, std::memory_order_relaxed);
+        return value;
+      }
+    }
+  }
+
+  // The tile is built before locking; another thread may have published
+  // it meanwhile, and then its copy is used.
+  const auto texels = build_tile(texture, level, tile);
+  const auto lock = std::scoped_lock(m_mutex);
+  const auto resident = texture.directory[tile].load(std::memory_order_relaxed);
+  const auto slot = resident != 0
+                        ? static_cast<std::size_t>(resident & 0xffffffffu) - 1
+                        : publish(texture, tile, texels);
+  m_slots[slot].referenced.store(true, std::memory_order_relaxed);
+  return m_texels[slot * tile_texels + offset].load(std::memory_order_relaxed);
+}
+
+inline auto TextureCache::resident_tile(const Texture& texture,
+                                        const std::size_t tile) noexcept
+    -> std::optional<Tile_t> {
+  const auto entry = texture.directory[tile].load(std::memory_order_acquire);
+  if (entry == 0)
+    return std::nullopt;
+  const auto slot = static_cast<std::size_t>(entry & 0xffffffffu) - 1;
+  const auto generation = static_cast<std::uint32_t>(entry >> 32);
+  auto& s = m_slots[slot];
+  if (s.generation.load(std::memory_order_acquire) != generation)
+    return std::nullopt;
+  auto texels = Tile_t{};
+  for (auto k = std::size_t{0}; k < tile_texels; ++k)
+    texels[k] =
+        m_texels[slot * tile_texels + k].load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (s.generation.load(std::memory_order_relaxed) != generation)
+    return std::nullopt;
+  if (!s.referenced.load(std::memory_order_relaxed))
+    s.referenced.store(true, std::memory_order_relaxed);
+  return texels;
+}
+
+// A base tile is copied from the file. A coarser tile averages 2x2 texels
+// of the level below, which lie in the 2x2 tiles under it; those come from
+// the cache when resident and are built here otherwise, without being
+// published, so a build never evicts the tiles it is reading. Odd rows
+// and columns at an edge are dropped, as in the level sizes.
+inline auto TextureCache::build_tile(const Texture& texture,
+                                     const std::size_t level,
+                                     const std::size_t tile) noexcept
+    -> Tile_t {
+  const auto& l = texture.levels[level];
+  const auto local = tile - l.first_tile;
+  const auto x0 = (local % l.tiles_x) * tile_size;
+  const auto y0 = (local / l.tiles_x) * tile_size;
+  auto texels = Tile_t{};
+  if (level == 0) {
+    for (auto j = std::size_t{0}; j < tile_size; ++j) {
+      for (auto i = std::size_t{0}; i < tile_size; ++i) {
+        const auto x = std::min(x0 + i, l.width - 1);
+        const auto y = std::min(y0 + j, l.height - 1);
+        texels[j * tile_size + i] = pack(texture.image.texel(x, y));
+      }
+    }
+    return texels;
+  }
+
+  const auto& finer = texture.levels[level - 1];
+  // indexed by the child's offset from (2 x0, 2 y0) in tiles
+  auto children = std::array<std::optional<Tile_t>, 4>{};
+  auto finer_texel = [&](const std::size_t x, const std::size_t y) {
+    const auto fx = std::min(x, finer.width - 1);
+    const auto fy = std::min(y, finer.height - 1);
+    const auto cx = fx / tile_size;
+    const auto cy = fy / tile_size;
+    auto& child = children[(cy - 2 * y0 / tile_size) * 2 +
+                           (cx - 2 * x0 / tile_size)];
+    if (!child) {
+      const auto index = finer.first_tile + cy * finer.tiles_x + cx;
+      child = resident_tile(texture, index);
+      if (!child)
+        child = build_tile(texture, level - 1, index);
+    }
+    return (*child)[(fy % tile_size) * tile_size + fx % tile_size];
+  };
+  for (auto j = std::size_t{0}; j < tile_size; ++j) {
+    for (auto i = std::size_t{0}; i < tile_size; ++i) {
+      const auto x = std::min(x0 + i, l.width - 1);
+      const auto y = std::min(y0 + j, l.height - 1);
+      texels[j * tile_size + i] =
+          average({finer_texel(2 * x, 2 * y), finer_texel(2 * x + 1, 2 * y),
+                   finer_texel(2 * x, 2 * y + 1),
+                   finer_texel(2 * x + 1, 2 * y + 1)});
+    }
+  }
+  return texels;
+}
+
+inline auto TextureCache::publish(
+    Texture& texture,
+    const std::size_t tile,
+    const Tile_t& texels) noexcept -> std::size_t {
+  const auto slot = next_victim();
+  auto& s = m_slots[slot];
+  if (s.texture) {
+    s.texture->directory[s.tile].store(0, std::memory_order_release);
+    ++m_evicted;
+  } else {
+    ++m_resident;
+  }
+
+  const auto generation = s.generation.load(std::memory_order_relaxed);
+  s.generation.store(generation + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (auto k = std::size_t{0}; k < tile_texels; ++k)
+    m_texels[slot * tile_texels + k].store(texels[k],
+                                           std::memory_order_relaxed);
+  s.generation.store(generation + 2, std::memory_order_release);
+  s.texture = &texture;
+  s.tile = tile;
+  s.referenced.store(false, std::memory_order_relaxed);
+  texture.directory[tile].store(
+      static_cast<std::uint64_t>(generation + 2) << 32 | (slot + 1),
+      std::memory_order_release);
+  ++m_loaded;
+  return slot;
+}
+
+// CLOCK: free slots first, then the first slot not referenced since the
+// hand last passed it.
+inline auto TextureCache::next_victim() noexcept -> std::size_t {
+  while (true) {
+    const auto slot = m_hand;
+    m_hand = (m_hand + 1) % m_capacity;
+    auto& s = m_slots[slot];
+    if (!s.texture || !s.referenced.exchange(false, std::memory_order_relaxed))
+      return slot;
+  }
+}
+
+inline auto TextureCache::average(
+    const std::array<std::uint32_t, 4>& texels) noexcept -> std::uint32_t {
+  auto rgb = std::array<std::uint8_t, 3>{};
+  for (auto c = 0; c < 3; ++c) {
+    auto sum = 0.;
+    for (const auto texel : texels) {
+      const auto s = static_cast<double>(channel(texel, c)) / 255;
+      sum += s * s;
+    }
+    rgb[static_cast<std::size_t>(c)] =
+        static_cast<std::uint8_t>(std::lround(std::sqrt(sum / 4) * 255));
+  }
+  return pack(rgb);
+}
+
+#endif  // !TEXTURE_CACHE_HPP
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of workers fed from one FIFO. Outlives individual renders so
+// frames and views can be scheduled without respawning threads.
+class ThreadPool {
+ public:
+  explicit ThreadPool(const std::size_t threads = default_threads()) {
+    m_workers.reserve(threads);
+    for (auto i = std::size_t{0}; i < threads; ++i)
+      m_workers.emplace_back(
+          [this](std::stop_token stop) { worker_loop(stop); });
+  }
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+  ~ThreadPool() {
+    for (auto& worker : m_workers)
+      worker.request_stop();
+    m_job_cv.notify_all();
+  }
+
+  template <class Fn>
+  auto submit(Fn&& fn) -> void {
+    {
+      const auto lock = std::lock_guard(m_mutex);
+      m_jobs.emplace_back(std::forward<Fn>(fn));
+      ++m_pending;
+    }
+    m_job_cv.notify_one();
+  }
+
+  // Blocks until every submitted job has finished.
+  auto wait() -> void {
+    auto lock = std::unique_lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_pending == 0; });
+  }
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t {
+    return m_workers.size();
+  }
+
+  [[nodiscard]] static auto default_threads() noexcept -> std::size_t {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+ private:
+  auto worker_loop(std::stop_token stop) -> void {
+    while (true) {
+      auto job = std::function<void()>{};
+      {
+        auto lock = std::unique_lock(m_mutex);
+        if (!m_job_cv.wait(lock, stop, [this] { return !m_jobs.empty(); }))
+          return;
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      job();
+      {
+        const auto lock = std::lock_guard(m_mutex);
+        --m_pending;
+      }
+      m_done_cv.notify_all();
+    }
+  }
+
+  std::mutex m_mutex{};
+  std::condition_variable_any m_job_cv{};
+  std::condition_variable m_done_cv{};
+  std::deque<std::function<void()>> m_jobs{};
+  std::size_t m_pending{};
+  std::vector<std::jthread> m_workers{};
+};
+
+#endif  // !THREAD_POOL_HPP
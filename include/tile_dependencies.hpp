@@ -0,0 +1,90 @@
+#ifndef TILE_DEPENDENCIES_HPP
+#define TILE_DEPENDENCIES_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "hit_record.hpp"
+
+// What a tile's camera rays and first bounces hit, as a Bloom filter over
+// (object, primitive) keys. A tile whose filter misses an edited key did
+// not see the edited primitive; a false positive only re-renders a tile
+// that did not need it.
+namespace dependencies {
+
+// Hits at bounce 0 (camera rays) and 1 are recorded; deeper bounces and
+// shadow rays are left to the staleness bound of IncrementalRenderer.
+inline constexpr int recorded_bounces = 2;
+
+class TileDependencies {
+ public:
+  // Stands for any primitive of an object, for edits replacing a whole set.
+  static constexpr std::uint32_t whole_object =
+      std::numeric_limits<std::uint32_t>::max();
+  // Recorded for hits standing for many primitives at once (a LOD proxy),
+  // which then match edits to any primitive of the object.
+  static constexpr std::uint32_t any_primitive = whole_object - 1;
+
+  auto add(const std::uint32_t object, const std::uint32_t primitive) noexcept
+      -> void {
+    set(key(object, primitive));
+    set(key(object, whole_object));
+  }
+  [[nodiscard]] auto may_depend_on(const std::uint32_t object,
+                                   const std::uint32_t primitive) const noexcept
+      -> bool {
+    return test(key(object, primitive)) || test(key(object, any_primitive));
+  }
+  auto clear() noexcept -> void { m_words = {}; }
+
+ private:
+  static constexpr std::size_t bits = 4096;
+
+  // SplitMix64 finalizer; its two halves give the two probes.
+  [[nodiscard]] static auto key(const std::uint32_t object,
+                                const std::uint32_t primitive) noexcept
+      -> std::uint64_t {
+    auto z = (std::uint64_t{object} << 32) | primitive;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+  auto set(const std::uint64_t key) noexcept -> void {
+    for (const auto bit : {key % bits, (key >> 32) % bits})
+      m_words[bit / 64] |= std::uint64_t{1} << (bit % 64);
+  }
+  [[nodiscard]] auto test(const std::uint64_t key) const noexcept -> bool {
+    for (const auto bit : {key % bits, (key >> 32) % bits})
+      if (!(m_words[bit / 64] & (std::uint64_t{1} << (bit % 64))))
+        return false;
+    return true;
+  }
+
+  std::array<std::uint64_t, bits / 64> m_words{};
+};
+
+// The filter of the tile the calling thread is rendering, else null.
+inline thread_local TileDependencies* recording = nullptr;
+
+// Clears `tile` and records into it until destroyed.
+class Recorder {
+ public:
+  explicit Recorder(TileDependencies& tile) noexcept {
+    tile.clear();
+    recording = &tile;
+  };
+  Recorder(const Recorder&) = delete;
+  auto operator=(const Recorder&) -> Recorder& = delete;
+  ~Recorder() { recording = nullptr; }
+};
+
+template <class T>
+auto record(const HitRecord<T>& hit, const int bounce) noexcept -> void {
+  if (recording && bounce < recorded_bounces)
+    recording->add(hit.object, hit.primitive);
+}
+
+}  // namespace dependencies
+
+#endif  // !TILE_DEPENDENCIES_HPP
@@ -0,0 +1,126 @@
+#ifndef TILE_STREAM_HPP
+#define TILE_STREAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <generator>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <utility>
+#include <vector>
+#include "camera.hpp"
+#include "color.hpp"
+#include "hittable_list.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+
+template <class T, class Image_t>
+struct RenderedTile {
+  Tile<Image_t> tile{};
+  // row-major, (x1 - x0) * (y1 - y0) pixels
+  std::vector<Color<T>> pixels{};
+};
+
+// Renders the camera's image on the pool and yields its tiles as they
+// finish, in completion order:
+//
+//   for (auto&& t : stream_tiles(pool, world, camera, 16, 2 * pool.size()))
+//     show(t.tile, t.pixels);
+//
+// At most `max_in_flight` tiles are queued, rendering or finished but not
+// yet taken, so a consumer that falls behind holds the workers back
+// instead of piling up pixels. Leaving the loop early, or a stop request
+// on `stop`, cancels the rest: tiles not started are skipped, tiles being
+// traced stop after their current row, and the generator returns once no
+// job of it is left on the pool. The consumer must therefore not run on
+// one of the pool's workers; `world` and `camera` must outlive it.
+//
+// The sizes are taken by value: the coroutine keeps its parameters for as
+// long as it is iterated.
+template <class T, class Image_t>
+[[nodiscard]] auto stream_tiles(ThreadPool& pool,
+                                const HittableList<T>& world,
+                                const Camera<T, Image_t>& camera,
+                                const Image_t tile_size,
+                                const std::size_t max_in_flight,
+                                std::stop_token stop = {})
+    -> std::generator<RenderedTile<T, Image_t>> {
+  // Shared with the jobs, which may still notify after the last tile.
+  struct State {
+    std::mutex mutex{};
+    std::condition_variable_any ready{};
+    std::deque<RenderedTile<T, Image_t>> done{};
+    std::size_t running{};
+    std::atomic<bool> cancelled{};
+  };
+  const auto state = std::make_shared<State>();
+  // Destroyed when the stream ends, is stopped or is abandoned mid-way.
+  struct Drain {
+    State& state;
+    ~Drain() {
+      state.cancelled = true;
+      auto lock = std::unique_lock(state.mutex);
+      state.ready.wait(lock, [this] { return state.running == 0; });
+    }
+  };
+  const auto drain = Drain{*state};
+
+  auto submit = [&](const Tile<Image_t>& tile) {
+    {
+      const auto lock = std::scoped_lock(state->mutex);
+      ++state->running;
+    }
+    pool.submit([state, stop, &world, &camera, tile] {
+      auto cancelled = [&] {
+        return state->cancelled.load(std::memory_order_relaxed) ||
+               stop.stop_requested();
+      };
+      auto rendered = RenderedTile<T, Image_t>{.tile = tile};
+      rendered.pixels.reserve(static_cast<std::size_t>(tile.area()));
+      for (auto y = tile.y0; y < tile.y1 && !cancelled(); ++y)
+        camera.trace_tile(
+            world, Tile<Image_t>{.x0 = tile.x0, .y0 = y, .x1 = tile.x1,
+                                 .y1 = y + 1},
+            [&rendered](auto, auto, const auto& c) {
+              rendered.pixels.push_back(c);
+            });
+      {
+        const auto lock = std::scoped_lock(state->mutex);
+        if (!cancelled())
+          state->done.push_back(std::move(rendered));
+        --state->running;
+      }
+      state->ready.notify_all();
+    });
+  };
+
+  const auto tiles =
+      make_tiles(camera.width(), camera.height(), tile_size);
+  auto next = tiles.begin();
+  const auto window = std::min(std::max<std::size_t>(max_in_flight, 1),
+                               tiles.size());
+  for (auto i = std::size_t{0}; i < window; ++i)
+    submit(*next++);
+
+  for (auto remaining = tiles.size(); remaining > 0; --remaining) {
+    auto rendered = RenderedTile<T, Image_t>{};
+    {
+      auto lock = std::unique_lock(state->mutex);
+      if (!state->ready.wait(lock, stop,
+                             [&state] { return !state->done.empty(); }))
+        co_return;
+      rendered = std::move(state->done.front());
+      state->done.pop_front();
+    }
+    // refill before handing over, so the workers keep going meanwhile
+    if (next != tiles.end())
+      submit(*next++);
+    co_yield std::move(rendered);
+  }
+}
+
+#endif  // !TILE_STREAM_HPP
@@ -0,0 +1,46 @@
+#ifndef TILES_HPP
+#define TILES_HPP
+
+#include <algorithm>
+#include <ranges>
+#include <vector>
+#include "utiltools.hpp"
+
+template <class Image_t>
+struct Tile {
+  Image_t x0{};
+  Image_t y0{};
+  Image_t x1{};
+  Image_t y1{};
+
+  [[nodiscard]] auto pixels() const noexcept {
+    return utiltools::cartesian_prod(std::views::iota(y0, y1),
+                                     std::views::iota(x0, x1));
+  }
+  [[nodiscard]] auto area() const noexcept -> Image_t {
+    return (x1 - x0) * (y1 - y0);
+  }
+};
+
+// Row-major tiles of at most size x size pixels covering the image.
+template <class Image_t>
+[[nodiscard]] auto make_tiles(const Image_t& width,
+                              const Image_t& height,
+                              const Image_t& size) -> std::vector<Tile<Image_t>> {
+  auto make_tile = [&](auto&& p) {
+    const auto [tx, ty] = p;
+    return Tile<Image_t>{.x0 = tx * size,
+                         .y0 = ty * size,
+                         .x1 = std::min(width, (tx + 1) * size),
+                         .y1 = std::min(height, (ty + 1) * size)};
+  };
+  const auto rows = std::views::iota(Image_t{0}, (height + size - 1) / size);
+  const auto cols = std::views::iota(Image_t{0}, (width + size - 1) / size);
+  auto tiles = std::vector<Tile<Image_t>>{};
+  std::ranges::for_each(
+      utiltools::cartesian_prod(rows, cols) | std::views::transform(make_tile),
+      [&tiles](auto&& tile) { tiles.push_back(tile); });
+  return tiles;
+}
+
+#endif  // !TILES_HPP
@@ -0,0 +1,160 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include "aabb.hpp"
+#include "globals.hpp"
+#include "vec3.hpp"
+
+// Affine map p -> A p + b, kept together with its inverse so instances can
+// take rays into object space and bring hits back without inverting a
+// matrix per ray. Built from translations, scales and rotations and
+// composed with `then`, which keeps both directions exact.
+template <class T>
+class Transform {
+ public:
+  Transform() : m_forward(identity()), m_inverse(identity()) {};
+
+  [[nodiscard]] static auto translate(const Vec3<T>& offset) noexcept
+      -> Transform;
+  [[nodiscard]] static auto scale(const Vec3<T>& factors) noexcept
+      -> Transform;
+  [[nodiscard]] static auto scale(const T& factor) noexcept -> Transform {
+    return scale(Vec3<T>{factor, factor, factor});
+  }
+  [[nodiscard]] static auto rotate_y(const T& radians) noexcept -> Transform;
+
+  // This transform followed by `next`.
+  [[nodiscard]] auto then(const Transform& next) const noexcept -> Transform {
+    return Transform(multiply(next.m_forward, m_forward),
+                     multiply(m_inverse, next.m_inverse));
+  }
+  [[nodiscard]] auto inverse() const noexcept -> Transform {
+    return Transform(m_inverse, m_forward);
+  }
+
+  [[nodiscard]] auto point(const Point3<T>& p) const noexcept -> Point3<T> {
+    return apply(m_forward, p, T{1});
+  }
+  [[nodiscard]] auto vector(const Vec3<T>& v) const noexcept -> Vec3<T> {
+    return apply(m_forward, v, T{0});
+  }
+  // Normals go through the inverse transpose; the result is not unit length.
+  [[nodiscard]] auto normal(const Vec3<T>& n) const noexcept -> Vec3<T>;
+  // Bound on the error of point(p) when p itself is off by up to p_error
+  // per component.
+  [[nodiscard]] auto point_error(const Point3<T>& p,
+                                 const Vec3<T>& p_error) const noexcept
+      -> Vec3<T>;
+  // Mean length scale, |det A|^(1/3); exact for uniform scales.
+  [[nodiscard]] auto scale_factor() const noexcept -> T;
+
+ private:
+  // Rows of [A | b].
+  using Matrix = std::array<std::array<T, 4>, 3>;
+
+  Transform(const Matrix& forward, const Matrix& inverse)
+      : m_forward(forward), m_inverse(inverse) {};
+
+  [[nodiscard]] static auto identity() noexcept -> Matrix {
+    return Matrix{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+  }
+  [[nodiscard]] static auto multiply(const Matrix& a, const Matrix& b) noexcept
+      -> Matrix;
+  [[nodiscard]] static auto apply(const Matrix& m,
+                                  const Vec3<T>& v,
+                                  const T& w) noexcept -> Vec3<T> {
+    auto row = [&m, &v, &w](const std::size_t r) {
+      return m[r][0] * v.x() + m[r][1] * v.y() + m[r][2] * v.z() + m[r][3] * w;
+    };
+    return Vec3<T>{row(0), row(1), row(2)};
+  }
+
+  Matrix m_forward;
+  Matrix m_inverse;
+};
+
+template <class T>
+auto Transform<T>::translate(const Vec3<T>& offset) noexcept -> Transform {
+  auto forward = identity();
+  auto inverse = identity();
+  for (auto r = std::size_t{0}; r < 3; ++r) {
+    forward[r][3] = axis(offset, static_cast<int>(r));
+    inverse[r][3] = -forward[r][3];
+  }
+  return Transform(forward, inverse);
+}
+
+template <class T>
+auto Transform<T>::scale(const Vec3<T>& factors) noexcept -> Transform {
+  auto forward = identity();
+  auto inverse = identity();
+  for (auto r = std::size_t{0}; r < 3; ++r) {
+    forward[r][r] = axis(factors, static_cast<int>(r));
+    inverse[r][r] = T{1} / forward[r][r];
+  }
+  return Transform(forward, inverse);
+}
+
+template <class T>
+auto Transform<T>::rotate_y(const T& radians) noexcept -> Transform {
+  const auto c = std::cos(radians);
+  const auto s = std::sin(radians);
+  const auto forward = Matrix{{{c, 0, s, 0}, {0, 1, 0, 0}, {-s, 0, c, 0}}};
+  const auto inverse = Matrix{{{c, 0, -s, 0}, {0, 1, 0, 0}, {s, 0, c, 0}}};
+  return Transform(forward, inverse);
+}
+
+template <class T>
+auto Transform<T>::normal(const Vec3<T>& n) const noexcept -> Vec3<T> {
+  const auto& m = m_inverse;
+  auto column = [&m, &n](const std::size_t c) {
+    return m[0][c] * n.x() + m[1][c] * n.y() + m[2][c] * n.z();
+  };
+  return Vec3<T>{column(0), column(1), column(2)};
+}
+
+// Rounding of the three products and sums per row (gamma_3), plus the
+// incoming error carried through A.
+template <class T>
+auto Transform<T>::point_error(const Point3<T>& p,
+                               const Vec3<T>& p_error) const noexcept
+    -> Vec3<T> {
+  const auto& m = m_forward;
+  auto row = [&m, &p, &p_error](const std::size_t r) {
+    const auto magnitude = std::abs(m[r][0] * p.x()) +
+                           std::abs(m[r][1] * p.y()) +
+                           std::abs(m[r][2] * p.z()) + std::abs(m[r][3]);
+    const auto carried = std::abs(m[r][0]) * p_error.x() +
+                         std::abs(m[r][1]) * p_error.y() +
+                         std::abs(m[r][2]) * p_error.z();
+    return globals::gamma<T>(3) * magnitude +
+           (1 + globals::gamma<T>(3)) * carried;
+  };
+  return Vec3<T>{row(0), row(1), row(2)};
+}
+
+template <class T>
+auto Transform<T>::scale_factor() const noexcept -> T {
+  const auto& m = m_forward;
+  const auto det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                   m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                   m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  return std::cbrt(std::abs(det));
+}
+
+template <class T>
+auto Transform<T>::multiply(const Matrix& a, const Matrix& b) noexcept
+    -> Matrix {
+  auto m = Matrix{};
+  for (auto r = std::size_t{0}; r < 3; ++r) {
+    for (auto c = std::size_t{0}; c < 4; ++c)
+      m[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c];
+    m[r][3] += a[r][3];
+  }
+  return m;
+}
+
+#endif  // !TRANSFORM_HPP
@@ -0,0 +1,149 @@
+#ifndef UNIX_SOCKET_HPP
+#define UNIX_SOCKET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Owning stream socket on a Unix domain path, with the buffered line and
+// block reads the render service protocol needs.
+class UnixSocket {
+ public:
+  UnixSocket() = delete;
+  UnixSocket(const UnixSocket&) = delete;
+  auto operator=(const UnixSocket&) -> UnixSocket& = delete;
+  UnixSocket(UnixSocket&& other) noexcept
+      : m_fd(std::exchange(other.m_fd, -1)),
+        m_buffer(std::move(other.m_buffer)) {};
+  ~UnixSocket() {
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+
+  // Replaces whatever is at `path`.
+  [[nodiscard]] static auto listen(const std::string& path)
+      -> std::optional<UnixSocket>;
+  [[nodiscard]] static auto connect(const std::string& path)
+      -> std::optional<UnixSocket>;
+
+  [[nodiscard]] auto accept() const -> std::optional<UnixSocket>;
+  // Wakes a thread blocked in accept() or a read on this socket.
+  auto shutdown() const noexcept -> void { ::shutdown(m_fd, SHUT_RDWR); }
+
+  // False once the peer has gone away; never raises SIGPIPE.
+  [[nodiscard]] auto send(std::span<const std::byte> bytes) const noexcept
+      -> bool;
+  [[nodiscard]] auto send(std::string_view text) const noexcept -> bool {
+    return send(std::as_bytes(std::span(text)));
+  }
+  // Next line without its '\n', nullopt at end of stream.
+  [[nodiscard]] auto read_line() -> std::optional<std::string>;
+  [[nodiscard]] auto read_exact(std::span<std::byte> out) -> bool;
+
+ private:
+  explicit UnixSocket(const int fd) : m_fd(fd) {};
+
+  [[nodiscard]] static auto address(const std::string& path)
+      -> std::optional<sockaddr_un>;
+  [[nodiscard]] auto fill() -> bool;
+
+  int m_fd{-1};
+  std::string m_buffer{};
+};
+
+inline auto UnixSocket::address(const std::string& path)
+    -> std::optional<sockaddr_un> {
+  auto addr = sockaddr_un{};
+  if (path.size() >= sizeof(addr.sun_path))
+    return std::nullopt;
+  addr.sun_family = AF_UNIX;
+  std::ranges::copy(path, addr.sun_path);
+  return addr;
+}
+
+inline auto UnixSocket::listen(const std::string& path)
+    -> std::optional<UnixSocket> {
+  const auto addr = address(path);
+  if (!addr)
+    return std::nullopt;
+  auto socket = UnixSocket(::socket(AF_UNIX, SOCK_STREAM, 0));
+  if (socket.m_fd < 0)
+    return std::nullopt;
+  ::unlink(path.c_str());
+  if (::bind(socket.m_fd, reinterpret_cast<const sockaddr*>(&addr.value()),
+             sizeof(sockaddr_un)) != 0 ||
+      ::listen(socket.m_fd, SOMAXCONN) != 0)
+    return std::nullopt;
+  return socket;
+}
+
+inline auto UnixSocket::connect(const std::string& path)
+    -> std::optional<UnixSocket> {
+  const auto addr = address(path);
+  if (!addr)
+    return std::nullopt;
+  auto socket = UnixSocket(::socket(AF_UNIX, SOCK_STREAM, 0));
+  if (socket.m_fd < 0 ||
+      ::connect(socket.m_fd, reinterpret_cast<const sockaddr*>(&addr.value()),
+                sizeof(sockaddr_un)) != 0)
+    return std::nullopt;
+  return socket;
+}
+
+inline auto UnixSocket::accept() const -> std::optional<UnixSocket> {
+  const auto fd = ::accept(m_fd, nullptr, nullptr);
+  if (fd < 0)
+    return std::nullopt;
+  return UnixSocket(fd);
+}
+
+inline auto UnixSocket::send(std::span<const std::byte> bytes) const noexcept
+    -> bool {
+  while (!bytes.empty()) {
+    const auto n = ::send(m_fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    bytes = bytes.subspan(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+inline auto UnixSocket::fill() -> bool {
+  char chunk[4096];
+  const auto n = ::recv(m_fd, chunk, sizeof(chunk), 0);
+  if (n <= 0)
+    return false;
+  m_buffer.append(chunk, static_cast<std::size_t>(n));
+  return true;
+}
+
+inline auto UnixSocket::read_line() -> std::optional<std::string> {
+  auto end = m_buffer.find('\n');
+  while (end == std::string::npos) {
+    if (!fill())
+      return std::nullopt;
+    end = m_buffer.find('\n');
+  }
+  auto line = m_buffer.substr(0, end);
+  m_buffer.erase(0, end + 1);
+  return line;
+}
+
+inline auto UnixSocket::read_exact(std::span<std::byte> out) -> bool {
+  while (m_buffer.size() < out.size())
+    if (!fill())
+      return false;
+  std::memcpy(out.data(), m_buffer.data(), out.size());
+  m_buffer.erase(0, out.size());
+  return true;
+}
+
+#endif  // !UNIX_SOCKET_HPP
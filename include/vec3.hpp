@@ -83,7 +83,7 @@ class Vec3 {
     // };
     // return Vec3<T>::random(-1, 1) | norm;
     while (true) {
-      auto p = Vec3<T>::random(-1., 1.);
+      auto p = Vec3<T>::random(T{-1}, T{1});
       if (p.length_squared() < 1)
         return p;
     }
@@ -106,13 +106,13 @@ class Vec3 {
   [[nodiscard]] static inline auto random_on_hemisphere(
       const Vec3<T>& normal) noexcept -> Vec3<T> {
     const auto on_unit_sphere = random_unit_vector();
-    return (dot(on_unit_sphere, normal) > 0.) ? on_unit_sphere
+    return (dot(on_unit_sphere, normal) > 0) ? on_unit_sphere
                                               : -on_unit_sphere;
   }
 
   [[nodiscard]] auto near_zero() const noexcept -> bool {
     using pipeline::operator|;
-    auto less_than_eps = [](auto v) { return v < 1e-8; };
+    auto less_than_eps = [](auto v) { return v < T{1e-8}; };
     auto labs = [](auto v) { return std::abs(v); };
     const auto fx = m_x | labs | less_than_eps;
     const auto fy = m_y | labs | less_than_eps;
@@ -191,6 +191,11 @@ template <class T>
                  u.x() * v.y() - u.y() * v.x());
 }
 
+template <class T>
+[[nodiscard]] inline auto abs(const Vec3<T>& v) noexcept -> Vec3<T> {
+  return Vec3<T>(std::abs(v.x()), std::abs(v.y()), std::abs(v.z()));
+}
+
 template <class T>
 [[nodiscard]] inline auto unit_vector(const Vec3<T>& v) noexcept -> Vec3<T> {
   return v / v.length();
@@ -206,10 +211,10 @@ template <class T>
 [[nodiscard]] inline auto refract(const Vec3<T>& uv,
                                   const Vec3<T>& n,
                                   const T& etai_over_etat) noexcept -> Vec3<T> {
-  const auto cos_theta = std::min<T>(dot(-uv, n), 1.);
+  const auto cos_theta = std::min<T>(dot(-uv, n), 1);
   const auto r_out_perp = etai_over_etat * (uv + cos_theta * n);
   const auto r_out_parallel =
-      -std::sqrt(std::abs(1. - r_out_perp.length_squared())) * n;
+      -std::sqrt(std::abs(1 - r_out_perp.length_squared())) * n;
   return r_out_perp + r_out_parallel;
 }
 
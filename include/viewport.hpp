@@ -2,6 +2,8 @@
 #define VIEWPORT_HPP
 
 #include <cmath>
+#include <optional>
+#include <utility>
 #include "globals.hpp"
 #include "vec3.hpp"
 template <class T>
@@ -33,8 +35,8 @@ class Viewport {
         m_pixel_du(calculate_pixel_delta(img_width, m_viewport_u)),
         m_pixel_dv(calculate_pixel_delta(img_height, m_viewport_v)),
         m_upper_left(m_camera_center - (focus_dist * m_w) -
-                     (m_viewport_u + m_viewport_v) / 2.),
-        m_pixel00_loc(m_upper_left + 0.5 * (m_pixel_du + m_pixel_dv)),
+                     (m_viewport_u + m_viewport_v) / T{2}),
+        m_pixel00_loc(m_upper_left + T{0.5} * (m_pixel_du + m_pixel_dv)),
         m_defocus_disk_u(m_u *
                          get_defocus_radius(m_focus_dist, m_defocus_angle)),
         m_defocus_disk_v(m_v *
@@ -61,6 +63,10 @@ class Viewport {
   [[nodiscard]] auto pixel00_loc() const noexcept -> const Vec3<T> {
     return m_pixel00_loc;
   };
+  // Angle subtended by one pixel, the spread of primary ray cones.
+  [[nodiscard]] auto pixel_spread() const noexcept -> T {
+    return m_pixel_du.length() / m_focus_dist;
+  }
   [[nodiscard]] auto defocus_angle() const noexcept -> const T {
     return m_defocus_angle;
   };
@@ -71,6 +77,11 @@ class Viewport {
     return m_defocus_disk_v;
   };
 
+  // Continuous pixel coordinates (pixel centers at integers) of a world
+  // point, nullopt when it lies behind the camera.
+  [[nodiscard]] auto project(const Point3<T>& p) const noexcept
+      -> std::optional<std::pair<T, T>>;
+
  private:
   template <class Image_t>
   [[nodiscard]] constexpr auto get_viewport_width(const T& height,
@@ -127,7 +138,20 @@ template <class T>
 auto Viewport<T>::get_defocus_radius(const T& focus_dist,
                                      const T& defocus_angle) const noexcept
     -> const T {
-  return focus_dist * std::tan(globals::degrees_to_radians(defocus_angle / 2.));
+  return focus_dist * std::tan(globals::degrees_to_radians(defocus_angle / 2));
+}
+
+template <class T>
+auto Viewport<T>::project(const Point3<T>& p) const noexcept
+    -> std::optional<std::pair<T, T>> {
+  const auto d = p - m_camera_center;
+  const auto depth = -dot(d, m_w);
+  if (depth <= 0)
+    return std::nullopt;
+  const auto on_plane = m_camera_center + d * (m_focus_dist / depth);
+  const auto offset = on_plane - m_pixel00_loc;
+  return std::pair{dot(offset, m_pixel_du) / m_pixel_du.length_squared(),
+                   dot(offset, m_pixel_dv) / m_pixel_dv.length_squared()};
 }
 
 #endif  // !VIEWPORT_HPP
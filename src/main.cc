@@ -1,47 +1,617 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include "batch.hpp"
 #include "camera.hpp"
 #include "color.hpp"
+#include "environment_light.hpp"
 #include "generate_data.hpp"
 #include "hit_record.hpp"
 #include "hittable_list.hpp"
-#include "materials/dielectric.hpp"
-#include "materials/lambertian.hpp"
-#include "materials/metal.hpp"
+#include "incremental_renderer.hpp"
+#include "mapped_framebuffer.hpp"
+#include "numa.hpp"
+#include "numa_renderer.hpp"
+#include "options.hpp"
+#include "perf_counters.hpp"
+#include "radiance_cache.hpp"
 #include "ray.hpp"
+#include "render_server.hpp"
+#include "render_stats.hpp"
+#include "scene_builder.hpp"
+#include "scene_cache.hpp"
+#include "scene_generator.hpp"
+#include "sequence.hpp"
+#include "shared_framebuffer.hpp"
+#include "textures/texture.hpp"
+#include "thread_pool.hpp"
+#include "tile_stream.hpp"
 
-auto main() -> int {
-  using T = double;
-  using Image_t = std::size_t;
+template <class T>
+auto report_scene(const HittableList<T>& world, const double build_seconds)
+    -> void {
+  const auto count = world.primitive_count();
+  const auto bytes = world.memory_bytes();
+  std::clog << "scene: " << count << " primitives, " << bytes << " bytes ("
+            << static_cast<double>(bytes) / static_cast<double>(count)
+            << " bytes/primitive), built in "
+            << std::format("{:.3f}", build_seconds) << " s\n";
+}
+
+// The book's scene on a sphere lattice of the given extent, stored as
+// `list`, `grid`, `compact` or `instanced` (copies of one sphere cluster).
+template <class T>
+auto make_lattice(const std::string_view structure,
+                  const int extent,
+                  const Albedo_t<T>& matte_albedo)
+    -> std::optional<HittableList<T>> {
+  auto world = HittableList<T>{};
+  if (structure == "compact") {
+    auto spheres = DataGenerator<T>(extent).get_compact_spheres();
+    if (!spheres) {
+      std::cerr << "lattice of extent " << extent
+                << " has more materials than a compact palette holds\n";
+      return std::nullopt;
+    }
+    world.add(std::move(spheres.value()));
+  } else if (structure == "grid") {
+    world.add(DataGenerator<T>(extent).get_sphere_grid());
+  } else if (structure == "instanced") {
+    world.add(DataGenerator<T>(extent).get_instanced_clusters());
+  } else if (structure == "list") {
+    world = DataGenerator<T>(extent).get_spheres();
+  } else {
+    return std::nullopt;
+  }
+
+  DataGenerator<T>().add_feature_spheres(world, matte_albedo);
+  return world;
+}
+
+// Spheres from SceneGenerator in place of the lattice, generated on all
+// threads; `instanced` has no meaning here and builds the list. The list
+// is filled chunk by chunk through a SceneBuilder, straight from the
+// generator's packed spheres.
+template <class T>
+auto make_generated(const Options& options,
+                    const std::string_view structure,
+                    const Albedo_t<T>& matte_albedo)
+    -> std::optional<HittableList<T>> {
+  const auto parameters = parse_scene_parameters<T>(options.generate.value());
+  if (!parameters)
+    return std::nullopt;
+  const auto generator = SceneGenerator<T>(parameters.value());
+  auto pool = ThreadPool(options.threads);
+  const auto start = std::chrono::steady_clock::now();
+  auto world = HittableList<T>{};
+  if (structure == "compact") {
+    world.add(generator.compact_set(pool));
+  } else if (structure == "grid") {
+    world.add(SphereGrid<T>(generator.spheres(pool)));
+  } else {
+    const auto count = parameters->count;
+    auto builder = SceneBuilder<T>(count +
+                                   DataGenerator<T>::feature_sphere_count);
+    const auto first = builder.claim(count).value();
+    const auto palette = generator.materials();
+    generator.for_each_chunk(pool, [&](const auto index, const auto chunk) {
+      auto slot = first + index;
+      for (const auto& s : chunk)
+        builder.emplace(slot++,
+                        Sphere<T>{Point3<T>{static_cast<T>(s.x),
+                                            static_cast<T>(s.y),
+                                            static_cast<T>(s.z)},
+                                  static_cast<T>(s.radius),
+                                  palette[s.material]});
+    });
+    world = builder.build();
+  }
+  std::clog << std::format(
+      "generated {} spheres in {:.2f} s\n", parameters->count,
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count());
+  DataGenerator<T>().add_feature_spheres(world, matte_albedo);
+  return world;
+}
+
+template <class T>
+auto make_world(const Options& options, const Albedo_t<T>& matte_albedo)
+    -> std::optional<HittableList<T>> {
+  const auto start = std::chrono::steady_clock::now();
+  const auto structure = options.compact     ? "compact"
+                         : options.grid      ? "grid"
+                         : options.instanced ? "instanced"
+                                             : "list";
+  auto world = options.generate
+                   ? make_generated<T>(options, structure, matte_albedo)
+                   : make_lattice<T>(structure, 11, matte_albedo);
+  if (world && options.lod) {
+    const auto error = static_cast<T>(options.lod.value());
+    for (auto i = std::size_t{0}; i < world->size(); ++i) {
+      const auto& object = world->object(i);
+      if (const auto* set = std::get_if<CompactSphereSet<T>>(&object))
+        world->replace(i, set->with_lod(error));
+    }
+  }
+  if (world)
+    report_scene(world.value(),
+                 std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+  return world;
+}
+
+// Scene references of the render service: `<structure>[:<extent>]`, e.g.
+// `grid:44`, with the structures of make_lattice.
+template <class T>
+auto build_scene(const std::string& reference,
+                 const Albedo_t<T>& matte_albedo)
+    -> std::optional<HittableList<T>> {
+  constexpr auto max_extent = 512;
+  const auto colon = reference.find(':');
+  auto extent = 11;
+  if (colon != std::string::npos) {
+    const auto* first = reference.data() + colon + 1;
+    const auto* last = reference.data() + reference.size();
+    const auto [end, error] = std::from_chars(first, last, extent);
+    if (error != std::errc{} || end != last || extent < 1 ||
+        extent > max_extent)
+      return std::nullopt;
+  }
+  return make_lattice<T>(std::string_view(reference).substr(0, colon), extent,
+                         matte_albedo);
+}
+
+template <class T, class Image_t>
+auto render_sequence(const Options& options,
+                     const HittableList<T>& world,
+                     const SequenceSettings<T, Image_t>& settings) -> int {
+  auto path_file = std::ifstream(options.sequence.value());
+  const auto path = parse_camera_path<T>(path_file);
+  if (!path) {
+    std::cerr << "cannot read camera path " << options.sequence.value()
+              << "\n";
+    return EXIT_FAILURE;
+  }
+
+  auto pool = ThreadPool(options.threads);
+  auto write_frame = [&options](auto index, const auto& frame) {
+    const auto name =
+        std::filesystem::path(options.output_dir) /
+        std::format("frame_{:04}.ppm", index);
+    auto out = std::ofstream(name);
+    frame.write_ppm(out);
+  };
+  SequenceRenderer<T, Image_t>(pool, world, settings)
+      .render(path.value(), options.frames, write_frame);
+  return EXIT_SUCCESS;
+}
+
+template <class T, class Image_t>
+auto render_batch(const Options& options,
+                  const HittableList<T>& world,
+                  const CameraSettings<T, Image_t>& settings,
+                  const CameraView<T>& default_view) -> int {
+  auto views = std::optional<std::vector<CameraView<T>>>{};
+  if (options.batch) {
+    auto views_file = std::ifstream(options.batch.value());
+    views = parse_camera_views<T>(views_file);
+  } else {
+    views = turntable(default_view, options.turntable.value());
+  }
+  if (!views) {
+    if (options.batch)
+      std::cerr << "cannot read camera views " << options.batch.value()
+                << "\n";
+    else
+      std::cerr << "a turntable needs at least one view\n";
+    return EXIT_FAILURE;
+  }
+
+  auto pool = ThreadPool(options.threads);
+  auto renderer = BatchRenderer<T, Image_t>(pool, world, settings, 16);
+  const auto framebuffers = renderer.render(views.value());
+  for (auto v = std::size_t{0}; v < framebuffers.size(); ++v) {
+    const auto name = std::filesystem::path(options.output_dir) /
+                      std::format("view_{:02}.ppm", v);
+    auto out = std::ofstream(name);
+    framebuffers[v].write_ppm(out);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Renders the single image in tiles on the pool and reports what each tile
+// cost; the image itself still goes to stdout.
+template <class T, class Image_t>
+auto render_profiled(const Options& options,
+                     const HittableList<T>& world,
+                     const Camera<T, Image_t>& camera) -> int {
+  auto pool = ThreadPool(options.threads);
+  auto profiler = RenderProfiler<Image_t>{};
+  auto framebuffer = Framebuffer<T, Image_t>(camera.width(), camera.height());
+  const auto tiles = make_tiles(camera.width(), camera.height(), Image_t{16});
+  for (const auto& tile : tiles)
+    pool.submit([&, tile] {
+      profiler.profile_tile(
+          tile, [&] { camera.render_tile(world, tile, framebuffer); });
+    });
+  pool.wait();
+
+  framebuffer.write_ppm(std::cout);
+  profiler.write_summary(std::clog);
+  if (options.heatmap) {
+    auto out = std::ofstream(options.heatmap.value());
+    profiler.write_heatmap(out, camera.width(), camera.height());
+  }
+  if (options.trace) {
+    auto out = std::ofstream(options.trace.value());
+    profiler.write_chrome_trace(out);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Renders the image, then makes `--incremental n` random edits to spheres
+// of the list, recoloring and lifting one in turn, and after each
+// re-renders only what IncrementalRenderer finds affected. Every state is
+// written to edit_00.ppm, ... in --output-dir.
+template <class T, class Image_t>
+auto render_incremental(const Options& options,
+                        HittableList<T> world,
+                        const Camera<T, Image_t>& camera) -> int {
+  auto spheres = std::vector<std::size_t>{};
+  for (auto i = std::size_t{0}; i < world.size(); ++i)
+    if (std::holds_alternative<Sphere<T>>(world.object(i)))
+      spheres.push_back(i);
+  if (spheres.empty()) {
+    std::cerr << "--incremental needs a scene with spheres in the list\n";
+    return EXIT_FAILURE;
+  }
+
+  auto pool = ThreadPool(options.threads);
+  auto renderer = IncrementalRenderer<T, Image_t>(pool, camera, Image_t{16},
+                                                  options.max_staleness);
+  auto write = [&options, &renderer](const std::size_t k) {
+    auto out = std::ofstream(std::filesystem::path(options.output_dir) /
+                             std::format("edit_{:02}.ppm", k));
+    renderer.framebuffer().write_ppm(out);
+  };
+  const auto full = renderer.render(world);
+  std::clog << std::format("full render: {} tiles, {:.2f} s\n", full.tiles,
+                           full.seconds);
+  write(0);
+
+  for (auto k = std::size_t{1}; k <= options.incremental.value(); ++k) {
+    const auto pick = std::min(
+        spheres.size() - 1,
+        static_cast<std::size_t>(globals::random_t<T>() *
+                                 static_cast<T>(spheres.size())));
+    const auto index = spheres[pick];
+    const auto sphere = std::get<Sphere<T>>(world.object(index));
+    const auto lift = k % 2 == 0;
+    const auto edited =
+        lift ? Sphere<T>(sphere.center() + Vec3<T>{0, sphere.radius(), 0},
+                         sphere.radius(), sphere.material())
+             : Sphere<T>(sphere.center(), sphere.radius(),
+                         Lambertian<T>{Color<T>::random()});
+    world.replace(index, edited);
+    const auto edit = SceneEdit<T>{
+        .object = static_cast<std::uint32_t>(index),
+        .bounds = lift ? std::optional(edited.bounding_box()) : std::nullopt};
+    const auto report = renderer.update(world, std::span(&edit, 1));
+    std::clog << std::format(
+        "edit {}: {} sphere {}, {} tiles invalidated, {} refreshed of {}, "
+        "{:.2f} s ({:.0f}% of full)\n",
+        k, lift ? "lifted" : "recolored", index, report.invalidated,
+        report.refreshed, report.tiles, report.seconds,
+        100 * report.seconds / full.seconds);
+    write(k);
+  }
+  return EXIT_SUCCESS;
+}
+
+// Renders the single image in tiles on the pool with every worker counting
+// cycles, instructions, cache and branch misses per render phase.
+template <class T, class Image_t>
+auto render_perf(const Options& options,
+                 const HittableList<T>& world,
+                 const Camera<T, Image_t>& camera) -> int {
+  auto session = perf::Session{};
+  {
+    auto pool = ThreadPool(options.threads);
+    auto framebuffer =
+        Framebuffer<T, Image_t>(camera.width(), camera.height());
+    const auto tiles =
+        make_tiles(camera.width(), camera.height(), Image_t{16});
+    for (const auto& tile : tiles)
+      pool.submit([&, tile] {
+        const auto attach = perf::Session::Attach(session);
+        camera.render_tile(world, tile, framebuffer);
+      });
+    pool.wait();
+
+    const auto attach = perf::Session::Attach(session);
+    const auto phase = perf::PhaseScope(perf::Phase::output);
+    framebuffer.write_ppm(std::cout);
+  }
+  session.write_report(std::clog);
+  return EXIT_SUCCESS;
+}
+
+// Renders the single image with NumaRenderer and reports per node where
+// the tiles and rays went. Node throughput is over the node's wall time;
+// the per-thread rate divides by the time its threads were busy.
+template <class T, class Image_t>
+auto render_numa(const Options& options,
+                 const HittableList<T>& world,
+                 const Camera<T, Image_t>& camera) -> int {
+  auto renderer = NumaRenderer<T, Image_t>(numa::topology(), options.threads,
+                                           options.numa_replicate);
+  renderer.render(world, camera, Image_t{16}).write_ppm(std::cout);
+  auto rate = [](const std::size_t rays, const double seconds) {
+    return seconds > 0 ? static_cast<double>(rays) / seconds / 1e6 : 0.;
+  };
+  for (const auto& node : renderer.reports())
+    std::clog << std::format(
+        "node {}: {} threads{}, {} tiles ({} stolen), {} rays, {:.2f} s wall, "
+        "{:.2f} Mrays/s ({:.2f} per thread, {:.2f} s busy){}\n",
+        node.node, node.threads, node.pinned ? "" : " (unpinned)", node.tiles,
+        node.stolen, node.rays, node.wall_seconds,
+        rate(node.rays, node.wall_seconds),
+        rate(node.rays, node.busy_seconds), node.busy_seconds,
+        node.replicated ? ", scene replica" : "");
+  return EXIT_SUCCESS;
+}
 
-  auto world = DataGenerator<T>().get_spheres();
+// Renders the single image through a MappedFramebuffer: tiles stream in
+// from the pool and go straight to the mapping, so only the tiles in
+// flight are held in memory, at any resolution.
+template <class T, class Image_t>
+auto render_out_of_core(const Options& options,
+                        const HittableList<T>& world,
+                        const Camera<T, Image_t>& camera) -> int {
+  constexpr auto tile_size = Image_t{64};
+  auto framebuffer = MappedFramebuffer<T, Image_t>::create(
+      options.out_of_core.value(), camera.width(), camera.height(), tile_size);
+  if (!framebuffer) {
+    std::cerr << "cannot map a framebuffer in " << options.out_of_core.value()
+              << "\n";
+    return EXIT_FAILURE;
+  }
+  auto pool = ThreadPool(options.threads);
+  for (auto&& rendered :
+       stream_tiles(pool, world, camera, tile_size, 2 * pool.size()))
+    framebuffer->store(rendered.tile, rendered.pixels);
+  framebuffer->write_ppm(std::cout);
+  return EXIT_SUCCESS;
+}
 
-  Material_t<T> ground_material = Lambertian<T>(Color<T>{0.5, 0.5, 0.5});
-  world.add(Sphere<T>{Point3<T>{0, -1000, 0}, 1000, ground_material});
-  Material_t<T> glass = Dielectric{1.5};
-  world.add(Sphere{Point3<T>{0, 1, 0}, 1.0, glass});
-  Material_t<T> matte = Lambertian{Color<T>{0.4, 0.2, 0.1}};
-  world.add(Sphere{Point3<T>{-4, 1, 0}, 1.0, matte});
-  Material_t<T> metal = Metal<T>{Color<T>{0.7, 0.6, 0.5}, 0.0};
-  world.add(Sphere<T>{Point3<T>{4, 1, 0}, 1.0, metal});
+// Renders the single image in passes into a SharedFramebuffer, each pass
+// tracing a share of the samples and blending it into the running means,
+// so viewers mapping the segment see the image converge. Tiles are traced
+// first and only then written under their seqlock, which keeps viewers
+// from retrying for the length of a trace.
+template <class T, class Image_t>
+auto render_shared(const Options& options,
+                   const HittableList<T>& world,
+                   const Camera<T, Image_t>& camera) -> int {
+  constexpr auto tile_size = Image_t{16};
+  constexpr auto max_passes = std::size_t{16};
+  const auto& name = options.shared_framebuffer.value();
+  const auto total = camera.samples_per_pixel();
+  const auto passes = std::min(total, max_passes);
+  auto framebuffer = SharedFramebuffer::create(
+      name, static_cast<std::uint32_t>(camera.width()),
+      static_cast<std::uint32_t>(camera.height()),
+      static_cast<std::uint32_t>(tile_size),
+      static_cast<std::uint32_t>(passes), static_cast<std::uint32_t>(total));
+  if (!framebuffer) {
+    std::cerr << "cannot create shared memory segment " << name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto tiles = make_tiles(camera.width(), camera.height(), tile_size);
+  auto pool = ThreadPool(options.threads);
+  auto done = std::size_t{0};
+  for (auto pass = std::size_t{0}; pass < passes; ++pass) {
+    const auto samples = total / passes + (pass < total % passes ? 1 : 0);
+    const auto weight =
+        static_cast<float>(samples) / static_cast<float>(done + samples);
+    for (auto i = std::size_t{0}; i < tiles.size(); ++i)
+      pool.submit([&, i, samples, weight] {
+        const auto& tile = tiles[i];
+        auto pixels = std::vector<Color<T>>{};
+        pixels.reserve(static_cast<std::size_t>(tile.area()));
+        for (auto&& pixel : tile.pixels())
+          pixels.push_back(camera.pixel_color(world, pixel, samples));
+        framebuffer->accumulate(i, tile, std::span<const Color<T>>(pixels),
+                                weight);
+      });
+    pool.wait();
+    done += samples;
+    framebuffer->finish_pass(static_cast<std::uint32_t>(done));
+  }
+  framebuffer->finish();
+  framebuffer->write_ppm<T>(std::cout);
+  std::clog << std::format(
+      "shm {}: {} passes of {} tiles; segment kept for viewers, "
+      "FramebufferViewer {} --unlink removes it\n",
+      name, passes, tiles.size(), name);
+  return EXIT_SUCCESS;
+}
 
+template <class T>
+auto camera_settings(const EnvironmentLight<T>& environment,
+                     std::shared_ptr<RadianceCache<T>> radiance_cache = {})
+    -> CameraSettings<T, std::size_t> {
   // CAMERA
-  const auto image_width = Image_t{200};
-  const auto aspect_ratio = T{16. / 9.};
+  const auto image_width = std::size_t{200};
+  const auto aspect_ratio = T{16} / T{9};
   const auto samples_per_pixel = 100;
   const auto max_depth = 50;
-  const auto v_fov = T{20};
-  const auto lookfrom = Vec3<T>{13, 2, 3};
-  const auto lookat = Vec3<T>{0, 0, 0};
   const auto v_up = Vec3<T>{0, 1, 0};
   const auto defocus_angle = T{0.6};
   const auto focus_distance = T{10};
 
-  Camera<T, Image_t>{image_width,   aspect_ratio, samples_per_pixel,
-                     max_depth,     v_fov,        lookfrom,
-                     lookat,        v_up,         defocus_angle,
-                     focus_distance}
-      .render(world);
+  return CameraSettings<T, std::size_t>{
+      .image_width = image_width,
+      .aspect_ratio = aspect_ratio,
+      .samples_per_pixel = samples_per_pixel,
+      .max_depth = max_depth,
+      .v_up = v_up,
+      .defocus_angle = defocus_angle,
+      .focus_distance = focus_distance,
+      .environment = environment,
+      .radiance_cache = std::move(radiance_cache)};
+}
+
+template <class T>
+auto render_world(const Options& options,
+                  const HittableList<T>& world,
+                  const EnvironmentLight<T>& environment,
+                  const std::shared_ptr<RadianceCache<T>>& radiance_cache)
+    -> int {
+  using Image_t = std::size_t;
 
+  const auto v_fov = T{20};
+  const auto lookfrom = Vec3<T>{13, 2, 3};
+  const auto lookat = Vec3<T>{0, 0, 0};
+  auto settings = camera_settings(environment, radiance_cache);
+  settings.image_width = options.width.value_or(settings.image_width);
+  settings.samples_per_pixel =
+      options.samples.value_or(settings.samples_per_pixel);
+  if (options.ambient_occlusion)
+    settings.ambient_occlusion =
+        static_cast<T>(options.ambient_occlusion.value());
+  const auto samples_per_pixel = settings.samples_per_pixel;
+
+  if (options.sequence) {
+    const auto sequence_settings =
+        SequenceSettings<T, Image_t>{.camera = settings,
+                                     .reuse_samples = samples_per_pixel / 8,
+                                     .max_history = 4 * samples_per_pixel,
+                                     .position_tolerance = T{0.01},
+                                     .tile_size = 16};
+    return render_sequence(options, world, sequence_settings);
+  }
+  if (options.batch || options.turntable) {
+    const auto default_view = CameraView<T>{
+        .lookfrom = lookfrom, .lookat = lookat, .v_fov = v_fov};
+    return render_batch(options, world, settings, default_view);
+  }
+
+  const auto camera = make_camera(settings, lookfrom, lookat, v_fov);
+  if (options.heatmap || options.trace)
+    return render_profiled(options, world, camera);
+  if (options.perf)
+    return render_perf(options, world, camera);
+  if (options.incremental)
+    return render_incremental(options, world, camera);
+  if (options.numa)
+    return render_numa(options, world, camera);
+  if (options.out_of_core)
+    return render_out_of_core(options, world, camera);
+  if (options.shared_framebuffer)
+    return render_shared(options, world, camera);
+  camera.render(world);
+
+  return EXIT_SUCCESS;
+}
+
+// Renders jobs from clients until one of them sends `shutdown`. Scenes are
+// built from their reference on first use and kept warm for later jobs.
+template <class T>
+auto serve(const Options& options,
+           const CameraSettings<T, std::size_t>& settings,
+           const Albedo_t<T>& matte_albedo) -> int {
+  auto pool = ThreadPool(options.threads);
+  auto scenes = SceneCache<T>(
+      options.scene_cache, [&matte_albedo](const std::string& reference) {
+        return build_scene<T>(reference, matte_albedo);
+      });
+  auto server = RenderServer<T>(pool, scenes, settings);
+  if (!server.serve(options.serve.value())) {
+    std::cerr << "cannot listen on " << options.serve.value() << "\n";
+    return EXIT_FAILURE;
+  }
   return EXIT_SUCCESS;
 }
+
+template <class T>
+auto run(const Options& options) -> int {
+  auto textures = TextureCache(options.texture_budget_mib << 20);
+  auto matte_albedo = Albedo_t<T>{Color<T>{T{0.4}, T{0.2}, T{0.1}}};
+  if (options.texture) {
+    const auto id = textures.add(options.texture.value());
+    if (!id) {
+      std::cerr << "cannot map texture " << options.texture.value() << "\n";
+      return EXIT_FAILURE;
+    }
+    matte_albedo = ImageTexture<T>{.cache = &textures, .id = id.value()};
+  }
+
+  auto environment = EnvironmentLight<T>::sky();
+  if (options.environment) {
+    auto map = EnvironmentLight<T>::load(options.environment.value());
+    if (!map) {
+      std::cerr << "cannot read environment " << options.environment.value()
+                << "\n";
+      return EXIT_FAILURE;
+    }
+    environment = std::move(map.value());
+  }
+
+  if (options.serve)
+    return serve<T>(options, camera_settings(environment), matte_albedo);
+
+  const auto world = make_world<T>(options, matte_albedo);
+  if (!world) {
+    if (options.generate)
+      std::cerr << "cannot generate scene " << options.generate.value()
+                << "\n";
+    return EXIT_FAILURE;
+  }
+  const auto radiance_cache =
+      options.radiance_cache
+          ? std::make_shared<RadianceCache<T>>(
+                static_cast<T>(options.radiance_cache.value()))
+          : nullptr;
+  const auto status =
+      render_world(options, world.value(), environment, radiance_cache);
+  if (radiance_cache) {
+    const auto stats = radiance_cache->stats();
+    std::clog << "radiance cache: " << stats.cells << " cells, "
+              << stats.converged << " converged, " << stats.capacity
+              << " slots\n";
+  }
+  if (options.texture) {
+    const auto stats = textures.stats();
+    std::clog << "textures: " << stats.loaded << " tiles loaded, "
+              << stats.evicted << " evicted, " << stats.resident << "/"
+              << stats.capacity << " slots resident\n";
+  }
+  return status;
+}
+
+auto main(int argc, char* argv[]) -> int {
+  const auto options = parse_options(argc, argv);
+  if (!options) {
+    print_usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+  if (options->single_precision)
+    return run<float>(options.value());
+  return run<double>(options.value());
+}
@@ -0,0 +1,131 @@
+#include "raytracer.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include "camera.hpp"
+#include "generate_data.hpp"
+#include "hittable_list.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+
+namespace raytracer {
+
+namespace {
+using T = double;
+using Image_t = std::size_t;
+
+constexpr auto tile_size = Image_t{16};
+
+auto to_point(const Vec3d& v) -> Point3<T> {
+  return Point3<T>{v[0], v[1], v[2]};
+}
+
+auto to_material(const MaterialDesc& desc) -> Material_t<T> {
+  switch (desc.kind) {
+    case MaterialDesc::Kind::metal:
+      return Metal<T>{to_point(desc.albedo), desc.fuzz};
+    case MaterialDesc::Kind::dielectric:
+      return Dielectric<T>{desc.refraction_index};
+    case MaterialDesc::Kind::lambertian:
+      break;
+  }
+  return Lambertian<T>{to_point(desc.albedo)};
+}
+
+// Camera derives its height from the aspect ratio by truncation; aiming at
+// the middle of the target row keeps it equal to the framebuffer height.
+auto make_settings(const CameraDesc& desc, const FramebufferView& framebuffer)
+    -> CameraSettings<T, Image_t> {
+  return CameraSettings<T, Image_t>{
+      .image_width = framebuffer.width,
+      .aspect_ratio = static_cast<T>(framebuffer.width) /
+                      (static_cast<T>(framebuffer.height) + 0.5),
+      .samples_per_pixel = desc.samples_per_pixel,
+      .max_depth = desc.max_depth,
+      .v_up = to_point(desc.v_up),
+      .defocus_angle = desc.defocus_angle,
+      .focus_distance = desc.focus_distance};
+}
+}  // namespace
+
+struct Scene::Impl {
+  HittableList<T> world{};
+};
+
+Scene::Scene() : m_impl(std::make_unique<Impl>()) {}
+Scene::Scene(Scene&&) noexcept = default;
+auto Scene::operator=(Scene&&) noexcept -> Scene& = default;
+Scene::~Scene() = default;
+
+auto Scene::add_sphere(const Vec3d& center,
+                       const double radius,
+                       const MaterialDesc& material) -> void {
+  m_impl->world.add(Sphere<T>{to_point(center), radius, to_material(material)});
+}
+
+auto Scene::book_cover() -> Scene {
+  auto scene = Scene{};
+  scene.m_impl->world = DataGenerator<T>().get_spheres();
+  DataGenerator<T>().add_feature_spheres(scene.m_impl->world);
+  return scene;
+}
+
+struct Renderer::Impl {
+  explicit Impl(const std::size_t threads) : pool(threads) {}
+  ThreadPool pool;
+};
+
+Renderer::Renderer(const std::size_t threads)
+    : m_impl(std::make_unique<Impl>(
+          threads > 0 ? threads : ThreadPool::default_threads())) {}
+Renderer::Renderer(Renderer&&) noexcept = default;
+auto Renderer::operator=(Renderer&&) noexcept -> Renderer& = default;
+Renderer::~Renderer() = default;
+
+auto Renderer::render(const Scene& scene,
+                      const CameraDesc& camera,
+                      const FramebufferView& framebuffer,
+                      const RenderCallbacks& callbacks) -> RenderStatus {
+  const auto stride =
+      framebuffer.stride > 0 ? framebuffer.stride : 3 * framebuffer.width;
+  if (!framebuffer.data || framebuffer.width == 0 || framebuffer.height == 0 ||
+      stride < 3 * framebuffer.width || camera.samples_per_pixel == 0)
+    return RenderStatus::invalid_framebuffer;
+
+  const auto cam = make_camera(make_settings(camera, framebuffer),
+                               to_point(camera.lookfrom),
+                               to_point(camera.lookat), camera.v_fov);
+  const auto& world = scene.m_impl->world;
+  auto write_pixel = [&framebuffer, stride](auto i, auto j, const auto& c) {
+    auto* rgb = framebuffer.data + j * stride + 3 * i;
+    rgb[0] = static_cast<float>(c.x());
+    rgb[1] = static_cast<float>(c.y());
+    rgb[2] = static_cast<float>(c.z());
+  };
+
+  const auto tiles =
+      make_tiles(framebuffer.width, framebuffer.height, tile_size);
+  auto done = std::atomic<std::size_t>{0};
+  for (const auto& tile : tiles)
+    m_impl->pool.submit([&, tile] {
+      if (!callbacks.stop.stop_requested())
+        cam.trace_tile(world, tile, write_pixel);
+      done.fetch_add(1);
+      done.notify_one();
+    });
+
+  auto reported = std::size_t{0};
+  while (reported < tiles.size()) {
+    done.wait(reported);
+    reported = done.load();
+    if (callbacks.progress)
+      callbacks.progress(reported, tiles.size());
+  }
+  m_impl->pool.wait();
+
+  return callbacks.stop.stop_requested() ? RenderStatus::cancelled
+                                         : RenderStatus::done;
+}
+
+}  // namespace raytracer
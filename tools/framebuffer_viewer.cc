@@ -0,0 +1,177 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "async_writer.hpp"
+#include "color.hpp"
+#include "shared_framebuffer.hpp"
+
+// Reference viewer for --shm renders: maps the segment read-only, reports
+// every pass and how many tiles changed since the last poll, and writes a
+// consistent snapshot of the image after each pass. Progress is read from
+// the mapping in place; only snapshots copy the texels out.
+//
+//   FramebufferViewer <name> [--snapshot <file.ppm>] [--interval <ms>]
+//                            [--unlink]
+namespace {
+
+using Texel = SharedFramebuffer::Texel;
+
+auto usage() -> int {
+  std::cerr << "usage: FramebufferViewer <name> [--snapshot <file.ppm>] "
+               "[--interval <ms>] [--unlink]\n";
+  return EXIT_FAILURE;
+}
+
+// The viewer may start before the renderer has created the segment.
+auto wait_for(const std::string& name,
+              const std::chrono::milliseconds interval) -> SharedFramebuffer {
+  for (auto waiting = false;; waiting = true) {
+    if (auto framebuffer = SharedFramebuffer::open(name))
+      return std::move(framebuffer.value());
+    if (!waiting)
+      std::clog << "waiting for " << name << "\n";
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+// Every tile as of one of its writes; a tile written during the copy is
+// copied again. Returns the retries.
+auto snapshot(const SharedFramebuffer& framebuffer,
+              const std::vector<Tile<std::uint32_t>>& tiles,
+              std::vector<Texel>& image) -> std::size_t {
+  const auto width = std::size_t{framebuffer.header().width};
+  auto retries = std::size_t{0};
+  auto texels = std::vector<Texel>{};
+  for (auto i = std::size_t{0}; i < tiles.size(); ++i) {
+    const auto& tile = tiles[i];
+    texels.resize(tile.area());
+    while (!framebuffer.read_tile(i, tile, texels)) {
+      ++retries;
+      std::this_thread::yield();
+    }
+    auto k = std::size_t{0};
+    for (auto y = tile.y0; y < tile.y1; ++y)
+      for (auto x = tile.x0; x < tile.x1; ++x)
+        image[y * width + x] = texels[k++];
+  }
+  return retries;
+}
+
+// Written next to `path` and renamed over it, so image viewers watching
+// the file never load half of one.
+auto write_ppm(const std::filesystem::path& path,
+               const SharedFramebuffer::Header& header,
+               std::span<const Texel> image) -> bool {
+  auto partial = path;
+  partial += ".part";
+  {
+    auto out = std::ofstream(partial);
+    auto writer = AsyncRowWriter<float>(out, header.width, header.height);
+    for (auto y = std::size_t{0}; y < header.height; ++y) {
+      auto row = std::vector<Color<float>>{};
+      row.reserve(header.width);
+      for (const auto& texel : image.subspan(y * header.width, header.width))
+        row.emplace_back(texel[0], texel[1], texel[2]);
+      writer.push(std::move(row));
+    }
+    writer.finish();
+    if (!out)
+      return false;
+  }
+  auto error = std::error_code{};
+  std::filesystem::rename(partial, path, error);
+  return !error;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, static_cast<std::size_t>(argc));
+  if (args.size() < 2)
+    return usage();
+  const auto name = std::string(args[1]);
+  auto snapshot_path = std::optional<std::filesystem::path>{};
+  auto interval = std::chrono::milliseconds{100};
+  auto unlink = false;
+  for (auto i = std::size_t{2}; i < args.size(); ++i) {
+    const auto arg = std::string(args[i]);
+    if (arg == "--snapshot" && i + 1 < args.size())
+      snapshot_path = args[++i];
+    else if (arg == "--interval" && i + 1 < args.size())
+      interval = std::chrono::milliseconds{std::atoi(args[++i])};
+    else if (arg == "--unlink")
+      unlink = true;
+    else
+      return usage();
+  }
+  if (interval.count() <= 0)
+    return usage();
+
+  const auto framebuffer = wait_for(name, interval);
+  const auto& header = framebuffer.header();
+  const auto tiles = framebuffer.tiles();
+  std::clog << std::format("{}: {}x{}, {} tiles of {}, {} passes, {} spp\n",
+                           name, header.width, header.height, tiles.size(),
+                           header.tile_size, header.total_passes,
+                           header.total_samples);
+
+  const auto start = std::chrono::steady_clock::now();
+  auto generations = std::vector<std::uint64_t>(tiles.size());
+  auto image =
+      std::vector<Texel>(std::size_t{header.width} * header.height);
+  auto seen_passes = std::uint32_t{0};
+  auto finished = false;
+  while (!finished) {
+    std::this_thread::sleep_for(interval);
+    finished = header.finished.load(std::memory_order_acquire) != 0;
+    const auto passes = header.passes.load(std::memory_order_acquire);
+    auto updated = std::size_t{0};
+    for (auto i = std::size_t{0}; i < tiles.size(); ++i) {
+      const auto generation = framebuffer.generation(i);
+      if (generation != generations[i])
+        ++updated;
+      generations[i] = generation;
+    }
+    if (passes == seen_passes && !finished) {
+      if (updated > 0)
+        std::clog << std::format("pass {}/{}: {} tiles updated\n",
+                                 passes + 1, header.total_passes, updated);
+      continue;
+    }
+    seen_passes = passes;
+    const auto seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    std::clog << std::format("{:.2f} s: {}/{} passes done, {} spp{}\n",
+                             seconds, passes, header.total_passes,
+                             header.samples.load(std::memory_order_relaxed),
+                             finished ? ", finished" : "");
+    if (!snapshot_path)
+      continue;
+    const auto retries = snapshot(framebuffer, tiles, image);
+    if (!write_ppm(snapshot_path.value(), header, image)) {
+      std::cerr << "cannot write " << snapshot_path->string() << "\n";
+      return EXIT_FAILURE;
+    }
+    if (retries > 0)
+      std::clog << std::format("  snapshot: {} tiles copied again\n",
+                               retries);
+  }
+
+  if (unlink && !SharedFramebuffer::unlink(name)) {
+    std::cerr << "cannot remove " << name << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "render_server.hpp"
+#include "unix_socket.hpp"
+
+// Stand-in for the orchestrator: sends the `render` lines read from stdin
+// to a RayTracingFunctionalCpp --serve instance, assembles the streamed
+// tiles and writes every finished job as <output-dir>/<id>.ppm.
+//
+//   RenderClient <socket> [--output-dir <dir>] [--shutdown] < jobs.txt
+namespace {
+
+struct Image {
+  std::size_t width{};
+  std::size_t height{};
+  std::vector<std::byte> pixels{};
+  std::size_t tiles{};
+  double first_tile_ms{-1};
+};
+
+auto write_ppm(const std::filesystem::path& path, const Image& image)
+    -> void {
+  auto out = std::ofstream(path);
+  out << "P3\n" << image.width << ' ' << image.height << "\n255\n";
+  for (auto k = std::size_t{0}; k < image.pixels.size(); k += 3)
+    out << std::to_integer<int>(image.pixels[k]) << ' '
+        << std::to_integer<int>(image.pixels[k + 1]) << ' '
+        << std::to_integer<int>(image.pixels[k + 2]) << '\n';
+}
+
+auto usage() -> int {
+  std::cerr << "usage: RenderClient <socket> [--output-dir <dir>] "
+               "[--shutdown] < jobs.txt\n";
+  return EXIT_FAILURE;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  const auto args = std::span(argv, static_cast<std::size_t>(argc));
+  if (args.size() < 2)
+    return usage();
+  auto output_dir = std::filesystem::path(".");
+  auto shutdown = false;
+  for (auto i = std::size_t{2}; i < args.size(); ++i) {
+    const auto arg = std::string(args[i]);
+    if (arg == "--output-dir" && i + 1 < args.size())
+      output_dir = args[++i];
+    else if (arg == "--shutdown")
+      shutdown = true;
+    else
+      return usage();
+  }
+
+  auto socket = UnixSocket::connect(args[1]);
+  if (!socket) {
+    std::cerr << "cannot connect to " << args[1] << "\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed_ms = [&start] {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  auto images = std::map<std::string, Image>{};
+  auto line = std::string{};
+  while (std::getline(std::cin, line)) {
+    auto in = std::istringstream(line);
+    auto command = std::string{};
+    auto fields = std::string{};
+    in >> command;
+    std::getline(in, fields);
+    if (command != "render")
+      continue;
+    const auto job = parse_render_job<double>(fields);
+    if (!job) {
+      std::cerr << "skipping malformed job: " << line << "\n";
+      continue;
+    }
+    images[job->id] =
+        Image{.width = job->width,
+              .height = job->height,
+              .pixels = std::vector<std::byte>(3 * job->width * job->height)};
+    if (!socket->send(line + "\n"))
+      return EXIT_FAILURE;
+  }
+
+  auto pending = images.size();
+  auto failed = false;
+  while (pending > 0) {
+    const auto reply = socket->read_line();
+    if (!reply) {
+      std::cerr << "server hung up with " << pending << " jobs pending\n";
+      return EXIT_FAILURE;
+    }
+    auto in = std::istringstream(reply.value());
+    auto kind = std::string{};
+    auto id = std::string{};
+    in >> kind >> id;
+    if (kind == "tile") {
+      auto x0 = std::size_t{};
+      auto y0 = std::size_t{};
+      auto x1 = std::size_t{};
+      auto y1 = std::size_t{};
+      in >> x0 >> y0 >> x1 >> y1;
+      auto& image = images.at(id);
+      auto tile = std::vector<std::byte>(3 * (x1 - x0) * (y1 - y0));
+      if (!socket->read_exact(tile))
+        return EXIT_FAILURE;
+      for (auto y = y0; y < y1; ++y)
+        std::ranges::copy(
+            std::span(tile).subspan(3 * (y - y0) * (x1 - x0), 3 * (x1 - x0)),
+            image.pixels.begin() +
+                static_cast<std::ptrdiff_t>(3 * (y * image.width + x0)));
+      ++image.tiles;
+      if (image.first_tile_ms < 0)
+        image.first_tile_ms = elapsed_ms();
+    } else if (kind == "done") {
+      auto ms = 0.;
+      auto cache = std::string{};
+      in >> ms >> cache;
+      const auto& image = images.at(id);
+      write_ppm(output_dir / (id + ".ppm"), image);
+      std::clog << std::format(
+          "{}: {} tiles, first after {:.1f} ms, done after {:.1f} ms "
+          "(render {:.1f} ms, scene cache {})\n",
+          id, image.tiles, image.first_tile_ms, elapsed_ms(), ms, cache);
+      --pending;
+    } else {
+      std::cerr << reply.value() << "\n";
+      failed = true;
+      if (images.contains(id))
+        --pending;
+    }
+  }
+
+  if (shutdown && !socket->send("shutdown\n"))
+    return EXIT_FAILURE;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}